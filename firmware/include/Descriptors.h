@@ -41,6 +41,8 @@
 	#include <LUFA/Drivers/USB/USB.h>
 	#include <avr/pgmspace.h>
 
+	#include "vendor.h"
+
 	// Type Defines:
 	// Type define for the device configuration descriptor structure. This must be defined in the application code, as the
 	// configuration descriptor contains several sub-descriptors which vary between devices, and which describe the device's
@@ -60,6 +62,16 @@
 		USB_HID_Descriptor_HID_t              HID2_MediaControllerHID;
 		USB_Descriptor_Endpoint_t             HID2_ReportINEndpoint;
 
+		// Vendor HID Interface
+		USB_Descriptor_Interface_t            HID3_VendorInterface;
+		USB_HID_Descriptor_HID_t              HID3_VendorHID;
+		USB_Descriptor_Endpoint_t             HID3_ReportINEndpoint;
+
+		// Mouse HID Interface
+		USB_Descriptor_Interface_t            HID4_MouseInterface;
+		USB_HID_Descriptor_HID_t              HID4_MouseHID;
+		USB_Descriptor_Endpoint_t             HID4_ReportINEndpoint;
+
 	} USB_Descriptor_Configuration_t;
 
 	// Enum for the device interface descriptor IDs within the device. Each interface descriptor should have a unique ID index
@@ -68,6 +80,8 @@
 	{
 		INTERFACE_ID_Keyboard = 0,		// Keyboard interface descriptor ID.
 		INTERFACE_ID_MediaController = 1,	// MediaController interface descriptor ID.
+		INTERFACE_ID_Vendor = 2,		// Vendor (configuration) interface descriptor ID.
+		INTERFACE_ID_Mouse = 3,			// Mouse (mouse keys) interface descriptor ID.
 	};
 
 	// Enum for the device string descriptor IDs within the device. Each string descriptor should have a unique ID index
@@ -88,6 +102,13 @@
 	// Endpoint address of the Media Control HID reporting IN endpoint.
 	#define MEDIACONTROLLER_IN_EPADDR	(ENDPOINT_DIR_IN | 3)
 
+	// Endpoint address of the Vendor HID reporting IN endpoint.  Required by the HID class but unused - the vendor interface only
+	// uses feature reports on the control endpoint.
+	#define VENDOR_IN_EPADDR		(ENDPOINT_DIR_IN | 4)
+
+	// Endpoint address of the Mouse HID reporting IN endpoint.
+	#define MOUSE_IN_EPADDR			(ENDPOINT_DIR_IN | 5)
+
 	// Size in bytes of the Media Control HID reporting IN endpoint.
 	#define HID_EPSIZE			8
 
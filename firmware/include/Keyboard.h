@@ -55,8 +55,23 @@
 	// keyscan.h and .c files written for specific use-case, custom board.
 	#include "keyscan.h"
 
-	// Needed to prevent double key-presses.  Small number of keys means key-scanning happens a bit too quickly.
-	#define DEBOUNCE_MS	2
+	// Adaptive scan rate and the system tick it runs on.
+	#include "governor.h"
+
+	// Key event pipeline (layers, tap-hold) that builds the keyscan report.
+	#include "events.h"
+
+	// Macros played in the background.
+	#include "macroplay.h"
+
+	// Cycle probes on the report stages (only compiled in with make PROFILE=1).
+	#include "profile.h"
+
+	// Time from power-up to the first report.
+	#include "boot.h"
+
+	// Backlight, for echoing the lock keys.
+	#include "leds.h"
 
 	// Definitions needed for controlling the LED to indicate numlock status.
 	#define NUMLOCK_LED_PORT	PORTB
@@ -65,24 +80,23 @@
 
 
 	// Type Defines:
-	// Type define for a Media Control HID report. This report contains the bits to match the usages defined in the HID report
-	// of the device.  When set to a true, the relevant media controls on the host will be triggered.
+	// Type define for a Media Control HID report.  This report is an array of consumer page usages, as defined in the HID report
+	// of the device.  Each non-zero usage is a consumer control (e.g. 0x00E9 Volume Up) held down on the host.
 	typedef struct
 	{
-		unsigned Play           : 1;
-		unsigned Pause          : 1;
-		unsigned FForward       : 1;
-		unsigned Rewind         : 1;
-		unsigned NextTrack      : 1;
-		unsigned PreviousTrack  : 1;
-		unsigned Stop           : 1;
-		unsigned PlayPause      : 1;
-		unsigned Mute           : 1;
-		unsigned VolumeUp       : 1;
-		unsigned VolumeDown     : 1;
-		unsigned RESERVED       : 5;
+		uint16_t Usage[MAX_CONSUMER_KEYS];
 	} ATTR_PACKED USB_MediaControllerReport_Data_t;
 
+	// Type define for a Mouse HID report, as defined in the HID report of the device.  Motion is relative, in pixels (and wheel
+	// steps) since the last report.
+	typedef struct
+	{
+		uint8_t Button;
+		int8_t  X;
+		int8_t  Y;
+		int8_t  Wheel;
+	} ATTR_PACKED USB_MouseKeysReport_Data_t;
+
 	// The following struct for keyboard reports is defined in the lufa library HIDClassCommon.h file.  It's
 	// included here for convenient reference.
 //	typedef struct
@@ -105,18 +119,13 @@
 	void EVENT_USB_Device_StartOfFrame(void);
 	void CreateKeyboardReport(USB_KeyboardReport_Data_t* const ReportData);
 	void CreateMediaControllerReport(USB_MediaControllerReport_Data_t* const MediaReportData);
-//	void CreateMacroKeyReport(USB_KeyboardReport_Data_t* const ReportData, char key_code, bool upper_case);
-void CreateMacroKeyReport(USB_KeyboardReport_Data_t* const ReportData, uint8_t keys[MAX_KEYS], uint8_t modifier);
+	bool CreateMouseReport(USB_MouseKeysReport_Data_t* const MouseReportData);
 
 	void numlock_led(bool on);
 	void ProcessLEDReport(const uint8_t LEDReport);
 	void SendNextKeyboardReport(void);
 	void ReceiveNextKeyboardReport(void);
 	void SendNextMediaControllerReport(void);
-//	void SendMacroReports(const char *macro_string);
-void SendMacroReports(void);
-	void type_key(char key);
-//	void SendNextMacroKeyReport(uint8_t key_code, bool upper_case);
-void SendNextMacroKeyReport(uint8_t key_code[MAX_KEYS], uint8_t modifiers);
+	void SendNextMouseReport(void);
 
 #endif
@@ -0,0 +1,48 @@
+#ifndef _BOOT_H_
+#define _BOOT_H_
+
+#include <avr/io.h>
+#include <stdbool.h>	// Needed for using true/false booleans.
+#include "systick.h"
+
+// Boot timing.  A pad that is plugged in (or re-enumerated by a dock) should report the keys already held on the host's very first
+// poll.  So USB is started first thing in hardware_init(), and the host's attach debounce and enumeration overlap the rest of the
+// start-up; the matrix is scanned from then on, configured or not, so the report is up to date before the host asks for it; and
+// every (re)configuration marks the report as changed, so the first poll after it carries the current keys.
+//
+// The time taken is recorded in boot_stats, which the host reads over the vendor interface (see vendor.h).  Interrupts (and so the
+// system tick) are off during hardware_init(), so its steps are timed with Timer4 (otherwise unused, and stopped again at the end
+// of hardware_init()) counting from the start of hardware_init() in steps of BOOT_TIMER_US.  Later milestones are timed with the
+// system tick.
+#define BOOT_TIMER_US		64					// clk/1024 at 16MHz.
+#define BOOT_TIMER_TCCRB	TCCR4B					// Timer/Counter Control Register B
+#define BOOT_TIMER_CS		((1 << CS43) | (1 << CS41) | (1 << CS40))	// Clock select bits for clk/1024.
+#define BOOT_TIMER_COUNT	TCNT4					// Timer/Counter Register (low byte)
+#define BOOT_TIMER_HIGH		TC4H					// High bits of the 10-bit Timer4 registers.
+#define BOOT_TIMER_TOP		OCR4C					// Timer/Counter Output Compare Register C (TOP)
+
+// Steps of hardware_init().
+#define BOOT_MARK_USB		0	// Watchdog and USB started (SetupHIDHardware()).
+#define BOOT_MARK_KEYSCAN	1	// Matrix, keymap and event pipeline set up (keyscan_init()).
+#define BOOT_MARK_INIT		2	// Everything else - the end of hardware_init().
+#define BOOT_MARKS		3
+
+typedef struct
+{
+	uint16_t mark_us[BOOT_MARKS];	// Time from the start of hardware_init() to the end of each step (up to 65ms).
+	uint16_t first_scan_ms;		// From the end of hardware_init() to the first scan of the matrix.
+	uint16_t configured_ms;		// From the end of hardware_init() to the host last configuring the device.
+	uint16_t report_ms;		// From the host last configuring the device to the first keyboard report written for it.
+	uint8_t configurations;		// Times the host has configured the device.
+} boot_stats_t;
+
+extern boot_stats_t boot_stats;
+
+// Declarations:
+void boot_start(void);
+void boot_mark(uint8_t mark);
+void boot_scanned(void);
+void boot_configured(void);
+void boot_report_sent(void);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _BOUNCE_H_
+#define _BOUNCE_H_
+
+#include <avr/io.h>
+#include <avr/eeprom.h>		// Needed for the stored debounce windows.
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include <string.h>		// Needed for memset.
+#include "keymap.h"
+#include "systick.h"
+
+// Per-key debounce.  After a key goes down or up, further changes of that key are ignored for its own window of
+// bounce_window[key] system ticks (SYSTICK_HZ, so 250us each).  Every key starts at DEBOUNCE_MS, and any windows stored in EEPROM
+// are loaded over that at boot.  Changed windows are stored by bounce_task() in the background, a byte per pass of the main loop.
+#define DEBOUNCE_MS		2					// Default window, in milliseconds.
+#define BOUNCE_DEFAULT_TICKS	(DEBOUNCE_MS * SYSTICK_TICKS_PER_MS)
+#define BOUNCE_MAX_TICKS	(20 * SYSTICK_TICKS_PER_MS)		// Longest window a key can be given (20ms).
+#define BOUNCE_MAGIC		0x4244					// Marks the stored windows as valid ("BD").
+
+// The bounce profiler.  Whilst it runs, every key has the longest window (so no bounce gets through), and every sample of the
+// matrix is checked for changes.  The first change of a key after a quiet window is an edge; each further change inside the window
+// is chatter, and the time from the edge to the last change inside the window is the bounce.  When the profiler is stopped the
+// window of each key seen for at least BOUNCE_MIN_EDGES edges can be tuned to just over its longest bounce and stored in EEPROM.
+// Both are driven by the host over the vendor interface (see vendor.h).  Best run whilst scanning at the fastest rate, i.e. whilst
+// keys are being pressed, as the samples are only as close together as the scans.
+#define BOUNCE_MIN_EDGES	20	// Edges a key needs before its window is tuned.
+#define BOUNCE_MARGIN_TICKS	2	// Added to the longest bounce seen (as well as the tick to get past it).
+
+// Status codes returned by bounce_set().  Shared with the vendor interface replies.
+#define BOUNCE_OK		0
+#define BOUNCE_BAD_ARG		2
+
+// What the profiler has seen of a key.
+typedef struct
+{
+	uint16_t edges;		// Edges (up to 65535).
+	uint8_t chatter;	// Changes inside the window after an edge (up to 255).
+	uint8_t bounce_ticks;	// Longest time from an edge to the last change inside its window.
+	uint16_t edge_tick;	// When the last edge was seen.
+} bounce_stats_t;
+
+extern uint8_t bounce_window[MATRIX_KEYS];
+extern bool bounce_profiling;
+
+// Declarations:
+void bounce_init(void);
+void bounce_start(const matrix_row_t *matrix);
+void bounce_sample(const matrix_row_t *samples, uint16_t now);
+uint8_t bounce_stop(bool tune);
+void bounce_read(uint8_t key, bounce_stats_t *stats);
+uint8_t bounce_set(uint8_t key, uint8_t ticks);
+void bounce_reset(void);
+void bounce_task(void);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _COMBO_H_
+#define _COMBO_H_
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>	// Needed for reading the combo array from flash.
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include "events.h"
+
+// Combo engine - the first stage of the key event pipeline.  A key that is part of a combo (see the combos in keymap.km) is held
+// back when pressed.  If the rest of a combo's keys go down within COMBO_TERM_MS the combo fires: its keys are suppressed (their
+// releases too) and the combo is sent on as a key of its own, numbered MATRIX_KEYS + the combo's index.  Otherwise the held back
+// presses are sent on in order as soon as they can no longer make a combo.  Keys that are in no combo are never held back.
+#define COMBO_TERM_MS	30
+
+// Bitmask with a bit for each combo.
+#if (MAX_COMBOS <= 8)
+typedef uint8_t combo_mask_t;
+#elif (MAX_COMBOS <= 16)
+typedef uint16_t combo_mask_t;
+#else
+typedef uint32_t combo_mask_t;
+#endif
+
+#if ((MATRIX_KEYS + MAX_COMBOS) > 255)
+#error "Too many keys and combos - each must have a uint8_t key number."
+#endif
+
+// Declarations:
+void combo_init(void);
+void combo_event(uint8_t key, bool pressed, uint16_t time);
+void combo_task(uint16_t now);
+keycode_t combo_keycode(uint8_t combo);
+
+#endif
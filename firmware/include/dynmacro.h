@@ -0,0 +1,39 @@
+#ifndef _DYNMACRO_H_
+#define _DYNMACRO_H_
+
+#include <avr/io.h>
+#include <avr/eeprom.h>		// Needed for saving the recording.
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include "events.h"
+
+// Dynamic macros.  DM_REC starts recording the resolved key events (as they are applied by the event pipeline) into a fixed arena of
+// DYNMACRO_EVENTS events, and DM_REC again or DM_STOP ends the recording.  Each press is recorded as the keycode its key resolved
+// to, so the recording does not depend on the layers that are active when it is played.  DM_PLAY feeds the recorded keycodes back
+// into the pipeline (events_play()) with the recorded gaps between them; DM_FAST feeds each one as soon as the previous one has
+// reached the host, so a sequence plays at machine speed.  Played keycodes go through the same layer functions, macros and reports
+// as keys typed by hand, but are not tied to a key, so a key held by hand whilst the same keycode is played stays down until both
+// let go of it.  DM_SAVE writes the recording to EEPROM (a byte at a time, in the background), from where it is loaded at boot.
+//
+// The dynamic macro keys themselves are never recorded.  Keys still held when the recording ends are released at the end of it, and
+// recording stops early once the arena only has room for those releases.  DM_STOP also ends playback, releasing any keys it has
+// pressed and not yet released.
+#define DYNMACRO_EVENTS		48		// 4 bytes of RAM (and EEPROM) each.
+#define DYNMACRO_TICK_MS	4		// Resolution of the recorded gaps.  The longest gap recorded is 255 ticks (1020ms).
+#define DYNMACRO_MAGIC		0x3244		// Marks a saved recording of keycodes ("D2").
+
+// A recorded event - the keycode, whether it went down (EVENT_PRESSED), and the gap since the previous event in DYNMACRO_TICK_MS
+// ticks.
+typedef struct
+{
+	keycode_t keycode;
+	uint8_t flags;
+	uint8_t ticks;
+} dynmacro_event_t;
+
+// Declarations:
+void dynmacro_init(void);
+void dynmacro_key(keycode_t keycode);
+void dynmacro_record(uint8_t key, uint8_t flags, keycode_t keycode);
+void dynmacro_task(uint16_t now);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+#include <avr/io.h>
+#include <stdbool.h>	// Needed for using true/false booleans.
+#include "keyscan.h"
+#include "systick.h"
+
+// The key event pipeline.  Each key that goes down or up is passed in as an event by the scanner (events_key()).  Events pass
+// through the combo engine (combo.c), then the tap-hold engine (taphold.c), which may hold them back whilst a dual-role key is
+// undecided, and come out as resolved events (events_output()).  Resolved events are queued and applied to the registered keys - the
+// keys the host sees as down - in order, at most one press and release of the same key per report so that nothing is lost when a
+// batch of events is flushed.  Held keys are repeated by the auto-repeat engine (repeat.c), which adds its own releases and presses
+// to the queue, and dynamic macros (dynmacro.c) queue the keycodes they play back.
+
+// Roles of a resolved key event.
+#define ROLE_KEY	0	// An ordinary key.
+#define ROLE_TAP	1	// A dual-role key resolved as a tap.
+#define ROLE_HOLD	2	// A dual-role key resolved as a hold.
+
+// Flags of a queued event - the role, whether the key went down, and whether it is a keycode played by the dynamic macro recorder
+// or a repeat made by the auto-repeat engine.
+#define EVENT_PRESSED	0x80
+#define EVENT_PLAYED	0x40
+#define EVENT_REPEAT	0x20
+#define EVENT_ROLE	0x03
+
+// Keys are numbered as in the key matrix (row * MATRIX_COLS + column), followed by a key for each combo.  The registered keys are
+// kept packed the same way as the key matrix, with extra rows for the combos.
+#define EVENT_KEYS	(MATRIX_KEYS + MAX_COMBOS)
+#define EVENT_ROWS	((EVENT_KEYS + MATRIX_COLS - 1) / MATRIX_COLS)
+
+// Number of resolved events that can wait to be applied.
+#define EVENTS_QUEUE_SIZE	16
+
+// Declarations:
+void events_init(void);
+void events_key(uint8_t key, bool pressed);
+void events_task(void);
+void events_output(uint8_t key, bool pressed, uint8_t role);
+void events_repeat(uint8_t key, bool pressed, uint8_t role);
+void events_play(keycode_t keycode, bool pressed);
+void events_apply(void);
+bool events_idle(void);
+void events_report_sent(void);
+keycode_t events_keycode(uint8_t key);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef _GOVERNOR_H_
+#define _GOVERNOR_H_
+
+#include <avr/io.h>
+#include <avr/sleep.h>	// Needed to idle the cpu between scans.
+#include <avr/power.h>	// Needed to set the cpu clock prescaler.
+#include <util/atomic.h>	// Needed for switching the clock and timers together.
+#include <stdbool.h>	// Needed for using true/false booleans.
+#include "systick.h"
+
+// The scan governor sets how often the key matrix is scanned.  Straight after any key activity the matrix is scanned on every
+// system tick (SYSTICK_HZ).  Once the keys have been idle for the hold time of the current rate, the governor steps down to the
+// next slower rate.  Any activity snaps it straight back to the fastest rate.
+#define SCAN_FAST_WINDOW_MS	1000	// How long to stay at the fastest rate after the last activity.
+
+// Number of scan rates defined in the scan_rates table (governor.c).
+#define NUM_SCAN_RATES	4
+
+// Clock scaling.  Once the governor steps down to GOVERNOR_SLOW_LEVEL (or slower) the cpu clock is divided by 8, to 2MHz.  The
+// system tick timer's prescaler is divided by 8 to match (systick_slow_clock()), and the pwm timer shortens its count by 8
+// (leds_slow_clock()), so the system tick, pwm and led effects run at the same rates as before.  The USB PLL is fed by the crystal
+// ahead of the system clock prescaler, so USB keeps running at full speed.  The first scan that sees a key down puts the clock
+// straight back to 16MHz, so whilst the keys are active the cpu only ever runs at full speed.  Comment out GOVERNOR_SLOW_CLOCK to
+// always run at full speed.
+#define GOVERNOR_SLOW_CLOCK
+#define GOVERNOR_SLOW_LEVEL	2	// The 250Hz scan rate.
+
+// Declarations:
+struct scan_rate
+{
+	uint8_t interval_ticks;	// Number of system ticks between scans.
+	uint16_t hold_ms;	// Idle time at this rate before stepping down to the next one.  Zero for the slowest rate.
+};
+
+// Governor counters.  level_entries[n] counts the transitions into rate n, wakeups counts the snaps back to the fastest rate.
+typedef struct
+{
+	uint8_t level;
+	uint16_t level_entries[NUM_SCAN_RATES];
+	uint16_t wakeups;
+	bool slow_clock;	// The cpu clock is divided down.
+} governor_stats_t;
+
+extern governor_stats_t governor_stats;
+
+void governor_init(void);
+bool governor_scan_due(void);
+void governor_activity(bool active);
+bool governor_idle(void);
+void governor_sleep(void);
+
+#endif
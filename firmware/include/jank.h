@@ -2,3 +2,4 @@
 
 #include "Keyboard.h"	// Pulls in all the lufa library defines.
 #include "leds.h"	// Configure and set a pwm timer, pulse timer and input butto signal for controlling LEDs.
+#include "settings.h"	// Settings saved in EEPROM (e.g. the led mode).
@@ -1,6 +1,16 @@
+#ifndef _KEYMAP_H_
+#define _KEYMAP_H_
+
 #include <avr/pgmspace.h>	// Required for writing to and reading from program memory space.
 
-// Define microcontroller registers for configuring inputs and outputs as required for keypad scanning.
+// Matrix geometry.  Rows and columns may be on any gpio pins across any of the AVR ports (see ROWn/COLn below).  The matrix state
+// is kept as a packed bit array - one matrix_row_t per row with a bit per column.
+#define MATRIX_ROWS	6
+#define MATRIX_COLS	4
+
+// When every row pin is on ROWS_PORT and every column pin is on COLS_PORT the scanner drives and reads those registers directly.
+// Comment out MATRIX_SINGLE_PORT for boards whose rows or columns span several ports (e.g. a 6x16 or 8x18 matrix).
+#define MATRIX_SINGLE_PORT
 #define ROWS_PORT	PORTD
 #define ROWS_DDR	DDRD
 #define ROWS_PINS	PIND
@@ -8,52 +18,145 @@
 #define COLS_DDR	DDRF
 #define COLS_PINS	PINF
 
+// Pins are identified by a code that combines the port and the bit.  On the ATmega32U4 the PINx, DDRx and PORTx registers of each
+// port are consecutive and each port's block of three follows the last, starting with PINB at i/o address 0x03.
+#define GPIO_B			0
+#define GPIO_C			1
+#define GPIO_D			2
+#define GPIO_E			3
+#define GPIO_F			4
+#define PIN_CODE(port, bit)	(((port) << 3) | (bit))
+#define PIN_CODE_PORT(code)	((code) >> 3)
+#define PIN_CODE_MASK(code)	(1 << ((code) & 0x07))
+#define PIN_CODE_PINS(code)	(&_SFR_IO8(0x03 + (3 * PIN_CODE_PORT(code))))	// Address of the PINx register.
+#define PIN_CODE_DDR(code)	(&_SFR_IO8(0x04 + (3 * PIN_CODE_PORT(code))))	// Address of the DDRx register.
+#define PIN_CODE_PORTS(code)	(&_SFR_IO8(0x05 + (3 * PIN_CODE_PORT(code))))	// Address of the PORTx register.
+
 // Define which physical microcontroller pins are conncted to the keypad rows and columns.
-#define ROW0	PD0
-#define ROW1	PD1
-#define ROW2	PD2
-#define ROW3	PD3
-#define ROW4	PD4
-#define ROW5	PD5
-#define COL0	PF0
-#define COL1	PF1
-#define COL2	PF4
-#define COL3	PF5
+#define ROW0	PIN_CODE(GPIO_D, PD0)
+#define ROW1	PIN_CODE(GPIO_D, PD1)
+#define ROW2	PIN_CODE(GPIO_D, PD2)
+#define ROW3	PIN_CODE(GPIO_D, PD3)
+#define ROW4	PIN_CODE(GPIO_D, PD4)
+#define ROW5	PIN_CODE(GPIO_D, PD5)
+#define COL0	PIN_CODE(GPIO_F, PF0)
+#define COL1	PIN_CODE(GPIO_F, PF1)
+#define COL2	PIN_CODE(GPIO_F, PF4)
+#define COL3	PIN_CODE(GPIO_F, PF5)
+#define MATRIX_ROW_PINS	{ROW0, ROW1, ROW2, ROW3, ROW4, ROW5}	// In order, row 0 first.
+#define MATRIX_COL_PINS	{COL0, COL1, COL2, COL3}		// In order, column 0 first.
 // !IMPORTANT! - By default, the JTAGEN (JTAG enable) bit is set (i.e. actually value zero which means enabled in the land of AVR
 // fuse bytes).  It must be cleared (i.e. set to 1!) otherwise PF4 and PF5 cannot be used as GPIO.  Out of the box the AtMega32U4
 // low fuse (lfuse) byte was set to 0x99.  Writing  this to 0xD9 disabled JTAG. 
 
-// Maximum number of rows and columns that should be identified as regular keystrokes or macros.
-#define MAX_NUM_KEY_ROWS	6
-#define MAX_NUM_KEY_COLS	4
-#define MAX_NUM_MACRO_ROWS	6
-#define MAX_NUM_MACRO_COLS	4
+// Keys are numbered (row * MATRIX_COLS) + column, so the whole matrix must fit in a uint8_t.
+#define MATRIX_KEYS	(MATRIX_ROWS * MATRIX_COLS)
+#if (MATRIX_KEYS > 255)
+#error "MATRIX_ROWS * MATRIX_COLS must be 255 or less."
+#endif
 
-// If the number of characters in a macro string defined in keymap.c exceeds this value, the macro will be truncated.
-#define MAX_MACRO_CHARS		40
-#define MAX_MACRO_ACTIONS	20
+// Smallest integer type that holds a bit for every column.
+#if (MATRIX_COLS <= 8)
+typedef uint8_t matrix_row_t;
+#elif (MATRIX_COLS <= 16)
+typedef uint16_t matrix_row_t;
+#elif (MATRIX_COLS <= 32)
+typedef uint32_t matrix_row_t;
+#else
+#error "MATRIX_COLS must be 32 or less."
+#endif
 
-// Identifiers used with macro_t (m_action element) to determine what to do with the macro_t array element.
+// Macros are packed byte-code, compiled from the keymap description by tools/kmc.py.  A macro is a series of actions, each an action
+// identifier followed by its arguments, ending with M_NULL:
 #define M_NULL	        0x00
-#define M_STRING	0x01	// If macro->m_action = M_STRING, then macro->m_array is a character string to be typed.
-#define M_KEYS		0x02	// If macro->m_action = M_KEYS, then macro->m_array is combination of keys to be pressed.
-#define M_WAIT          0x03	// If macro->m_action = M_WAIT, then macro->m_array is an array of integer seconds to pause.
-
-// Define the structure of a macro.  The macros are actually defined as an array of type macro_t so that multiple macros can be
-// run sequentially with a single keypress.
-typedef struct {
-	uint8_t m_action;
-	char m_array[MAX_MACRO_CHARS];  // m_array is interpreted differently depending on the value of m_action.  See above.
-} macro_t;
-
-
-// Declare the key-to-pin, macro-to-pin, keymap and macromap arrays.
-extern const uint8_t key_row_array[MAX_NUM_KEY_ROWS];
-extern const uint8_t key_col_array[MAX_NUM_KEY_COLS];
-extern const uint8_t macro_row_array[MAX_NUM_MACRO_ROWS];
-extern const uint8_t macro_col_array[MAX_NUM_MACRO_COLS];
-extern const char KEYMAP[MAX_NUM_KEY_ROWS][MAX_NUM_KEY_COLS];
-extern const macro_t MACROMAP[MAX_NUM_MACRO_ROWS][MAX_NUM_MACRO_COLS][MAX_MACRO_ACTIONS];
+#define M_STRING	0x01	// M_STRING, n, c1 .. cn - type the n characters.
+#define M_KEYS		0x02	// M_KEYS, n, k1 .. kn - press the n keys (scan-codes, including modifiers) together, then release them.
+#define M_WAIT          0x03	// M_WAIT, lo, hi - pause for lo + 256 * hi milliseconds.
+#define M_ZSTRING	0x04	// M_ZSTRING, t - type compressed text number t (see zstring.h).
+#define M_PACE		0x05	// M_PACE, f, g - type the rest of the macro at pace f, g (see macroplay.h).
+
+// A macro is referred to by the address (in flash) of its first byte.
+typedef uint8_t macro_t;
+
+// Keymap entries are 16-bit keycodes.  A keycode of 0x00FF or less is a basic key - the low byte is one of the scan-codes below
+// (including the modifier and macro keys).  The high byte of any other keycode identifies a special function.
+typedef uint16_t keycode_t;
+#define KC_BASIC_MAX	0x00FF
+#define KC_KIND(k)	((k) & 0xFF00)		// Identifies the special function of a keycode.
+#define KC_ARG(k)	((k) & 0x00FF)		// The argument (e.g. the layer number) of a special function.
+
+// A key is assigned a macro by putting MACRO(n) in the keymap, where n is the number of the macro in macro_data (0 to 31).
+#define MACRO(n)	(HID_KEYBOARD_SC_MACRO_FIRST + (n))
+
+// SMACRO(n) plays macro n from the macro store written by the host (see macrostore.h), if there is one (0 to 255).
+#define KC_SMACRO	0x0500
+#define SMACRO(n)	(KC_SMACRO | (n))
+
+// Dynamic macros - key sequences recorded on the keypad itself and played back (see dynmacro.h).
+#define KC_DYNMACRO	0x0600
+#define DM_REC		(KC_DYNMACRO | 0)	// Start recording (or stop, if recording).
+#define DM_STOP		(KC_DYNMACRO | 1)	// Stop recording or playing.
+#define DM_PLAY		(KC_DYNMACRO | 2)	// Play the recording with the timing it was recorded with.
+#define DM_FAST		(KC_DYNMACRO | 3)	// Play the recording as fast as the host takes reports.
+#define DM_SAVE		(KC_DYNMACRO | 4)	// Save the recording to EEPROM, to be loaded at the next boot.
+
+// Mouse keys - move the pointer, press the buttons and turn the wheel on the mouse interface (see mousekey.h).
+#define KC_MOUSE	0x0700
+#define MS_UP		(KC_MOUSE | 0)
+#define MS_DOWN		(KC_MOUSE | 1)
+#define MS_LEFT		(KC_MOUSE | 2)
+#define MS_RIGHT	(KC_MOUSE | 3)
+#define MS_BTN1		(KC_MOUSE | 4)		// Left button.
+#define MS_BTN2		(KC_MOUSE | 5)		// Right button.
+#define MS_BTN3		(KC_MOUSE | 6)		// Middle button.
+#define MS_WH_UP	(KC_MOUSE | 7)
+#define MS_WH_DOWN	(KC_MOUSE | 8)
+
+// Layers.  KEYMAPS holds up to MAX_LAYERS keymaps, layer 0 being the base layer which is always active.  When a key goes down it is
+// looked up in the highest active layer, falling through to the next lower active layer only where that layer has KC_TRNS.
+#define MAX_LAYERS	8
+#define KC_TRNS		0x0100			// Transparent - use the key from the next lower active layer.
+#define KC_MO		0x0200
+#define KC_TG		0x0300
+#define KC_OSL		0x0400
+#define MO(l)		(KC_MO | (l))		// Momentary - layer l is active while the key is held.
+#define TG(l)		(KC_TG | (l))		// Toggle - each press turns layer l on or off.
+#define OSL(l)		(KC_OSL | (l))		// One-shot - layer l is active for the next key press only.
+
+// Dual-role (tap-hold) keys send the basic keycode kc when tapped and act as a layer or modifier when held.  The hold function is
+// in bits 8 to 11 - the layer (LT) or the modifier 0 to 7 in the order of the modifier scan-codes (MT, bit 11 set).
+#define LT(l, kc)		(0x1000 | ((l) << 8) | (kc))				// Tap for kc, hold for momentary layer l.
+#define MT(mod, kc)		(0x1800 | (((mod) - HID_KEYBOARD_SC_LEFT_CONTROL) << 8) | (kc))	// Tap for kc, hold for modifier mod.
+#define KC_IS_TAP_HOLD(k)	(((k) & 0xF000) == 0x1000)
+#define KC_IS_MT(k)		((k) & 0x0800)
+#define KC_TAP(k)		((k) & 0x00FF)
+#define KC_HOLD(k)		(KC_IS_MT(k) ? (HID_KEYBOARD_SC_LEFT_CONTROL + (((k) >> 8) & 0x07)) : MO(((k) >> 8) & 0x07))
+
+// Consumer keys send a usage from the HID consumer page (0x001 to 0xFFF) on the media controller interface.  Any usage can go in the
+// keymap as CONSUMER(usage) - the common ones are named HID_MEDIACONTROLLER_SC_* below.
+#define KC_CONSUMER		0x4000
+#define CONSUMER(u)		(KC_CONSUMER | (u))
+#define KC_IS_CONSUMER(k)	(((k) & 0xF000) == KC_CONSUMER)
+#define KC_CONSUMER_USAGE(k)	((k) & 0x0FFF)
+
+// Combos - keys pressed together that send a different keycode (which may be a macro).  Each combo lists up to COMBO_MAX_KEYS key
+// positions, padded with COMBO_END.
+#define MAX_COMBOS		8	// Up to 32.
+#define COMBO_MAX_KEYS		4
+#define COMBO_END		0xFF
+#define KEY_POS(r, c)		((r) * MATRIX_COLS + (c))
+typedef struct
+{
+	uint8_t keys[COMBO_MAX_KEYS];
+	keycode_t keycode;
+} combo_t;
+
+// Declare the keymap, macro and combo arrays, generated from the keymap description.
+extern const keycode_t KEYMAPS[][MATRIX_ROWS][MATRIX_COLS];
+extern const uint8_t keymap_num_layers;
+extern keycode_t keymap_ram[];		// The keymap as used - KEYMAPS plus any runtime overrides (see remap.h).
+extern const combo_t COMBOS[];
+extern const uint8_t num_combos;
 
 // Key scan-codes:
 // Note these are defined in the lufa library file LUFA/Drivers/USB/Class/Common/HIDClassCommon.h but repeated again
@@ -161,6 +264,10 @@ extern const macro_t MACROMAP[MAX_NUM_MACRO_ROWS][MAX_NUM_MACRO_COLS][MAX_MACRO_
 #define HID_KEYBOARD_SC_NON_US_BACKSLASH_AND_PIPE		0x64
 #define HID_KEYBOARD_SC_APPLICATION				0x65
 
+// Unused by the keyboard usage page, so used here to identify macro keys.  See MACRO(n) above.
+#define HID_KEYBOARD_SC_MACRO_FIRST				0xC0
+#define HID_KEYBOARD_SC_MACRO_LAST				0xDF
+
 #define HID_KEYBOARD_SC_LEFT_CONTROL				0xE0
 #define HID_KEYBOARD_SC_LEFT_SHIFT				0xE1
 #define HID_KEYBOARD_SC_LEFT_ALT				0xE2
@@ -170,14 +277,36 @@ extern const macro_t MACROMAP[MAX_NUM_MACRO_ROWS][MAX_NUM_MACRO_COLS][MAX_MACRO_
 #define HID_KEYBOARD_SC_RIGHT_ALT				0xE6
 #define HID_KEYBOARD_SC_RIGHT_GUI				0xE7
 
-#define HID_MEDIACONTROLLER_SC_PLAY				0xF0
-#define HID_MEDIACONTROLLER_SC_PAUSE				0xF1
-#define HID_MEDIACONTROLLER_SC_FAST_FORWARD			0xF2
-#define HID_MEDIACONTROLLER_SC_REWIND				0xF3
-#define HID_MEDIACONTROLLER_SC_NEXT				0xF4
-#define HID_MEDIACONTROLLER_SC_PREVIOUS				0xF5
-#define HID_MEDIACONTROLLER_SC_STOP				0xF6
-#define HID_MEDIACONTROLLER_SC_TOGGLE				0xF7
-#define HID_MEDIACONTROLLER_SC_MUTE				0xF8
-#define HID_MEDIACONTROLLER_SC_VOLUME_UP			0xF9
-#define HID_MEDIACONTROLLER_SC_VOLUME_DOWN			0xFA
+// Consumer keys - CONSUMER() of the consumer page usage.
+#define HID_MEDIACONTROLLER_SC_BRIGHTNESS_UP			0x406F
+#define HID_MEDIACONTROLLER_SC_BRIGHTNESS_DOWN			0x4070
+#define HID_MEDIACONTROLLER_SC_PLAY				0x40B0
+#define HID_MEDIACONTROLLER_SC_PAUSE				0x40B1
+#define HID_MEDIACONTROLLER_SC_FAST_FORWARD			0x40B3
+#define HID_MEDIACONTROLLER_SC_REWIND				0x40B4
+#define HID_MEDIACONTROLLER_SC_NEXT				0x40B5
+#define HID_MEDIACONTROLLER_SC_PREVIOUS				0x40B6
+#define HID_MEDIACONTROLLER_SC_STOP				0x40B7
+#define HID_MEDIACONTROLLER_SC_EJECT				0x40B8
+#define HID_MEDIACONTROLLER_SC_TOGGLE				0x40CD
+#define HID_MEDIACONTROLLER_SC_MUTE				0x40E2
+#define HID_MEDIACONTROLLER_SC_VOLUME_UP			0x40E9
+#define HID_MEDIACONTROLLER_SC_VOLUME_DOWN			0x40EA
+#define HID_MEDIACONTROLLER_SC_MEDIA_SELECT			0x4183
+#define HID_MEDIACONTROLLER_SC_MAIL				0x418A
+#define HID_MEDIACONTROLLER_SC_CALCULATOR			0x4192
+#define HID_MEDIACONTROLLER_SC_MY_COMPUTER			0x4194
+#define HID_MEDIACONTROLLER_SC_BROWSER				0x4196
+#define HID_MEDIACONTROLLER_SC_SCREEN_LOCK			0x419E
+#define HID_MEDIACONTROLLER_SC_SEARCH				0x4221
+#define HID_MEDIACONTROLLER_SC_HOME				0x4223
+#define HID_MEDIACONTROLLER_SC_BACK				0x4224
+#define HID_MEDIACONTROLLER_SC_FORWARD				0x4225
+#define HID_MEDIACONTROLLER_SC_REFRESH				0x4227
+#define HID_MEDIACONTROLLER_SC_BOOKMARKS			0x422A
+
+// The tables generated from the keymap description (KEYMAP_LAYERS, MACRO_COUNT, macro_data, macro_offsets and the compressed
+// macro text).
+#include "keymap_gen.h"
+
+#endif
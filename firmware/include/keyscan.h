@@ -1,38 +1,76 @@
+#ifndef _KEYSCAN_H_
+#define _KEYSCAN_H_
+
 #include <avr/io.h>
 #include <string.h>		// Included for memset function.
 #include <stdbool.h>		// Included to use bool type and true/false values.
 #include "keymap.h"
+#include "layers.h"
+#include "bounce.h"
+#include "profile.h"
+#include "mousekey.h"
+
+// Row-settle pipelining.  Instead of spinning on ROWS_PINS after driving each row, the scanner latches the columns of one row, then
+// releases it and drives the next row in the same write and waits a fixed number of cpu cycles before latching again.  A row with a
+// key down is instead released on its own, and its columns checked after the settle time for having recovered, before the next row
+// is driven.  The whole matrix is therefore sampled in a bounded number of cycles (roughly rows * (KEYSCAN_SETTLE_CYCLES + 12), plus
+// KEYSCAN_SETTLE_CYCLES for each row with a key down).  Comment out KEYSCAN_PIPELINED to revert to the spin-wait scan.
+#define KEYSCAN_PIPELINED
+
+// Cycles to wait after driving a row before latching the columns.  Must cover both the row propagation delay (measured in cpu cycles
+// at start-up into keyscan_stats.row_settle_cycles) and the columns of the previous row recovering through the pull-ups (checked
+// between rows on every scan, a shortfall is counted in keyscan_stats.recovery_faults).  16 cycles = 1us at 16MHz.
+#define KEYSCAN_SETTLE_CYCLES	16
+
+// A row that has not read back low within this many cycles of being driven is stuck, and calibration gives up on it.
+#define KEYSCAN_STUCK_CYCLES	1000
+
+// Maximum number of ports the columns are read from on each row.
+#ifdef MATRIX_SINGLE_PORT
+#define COL_PORTS	1
+#else
+#define COL_PORTS	5	// Columns can be on any of ports B to F.
+#endif
 
 // Max number of simultaneous key-presses (excluding media keys and modifiers).
 #define MAX_KEYS	6
 
-// Bit-shift definitions for the uint16_t media_keys integer:
-#define MK_PLAY		 0
-#define MK_PAUSE	 1
-#define MK_FF		 2
-#define MK_RW		 3
-#define MK_NEXT		 4
-#define MK_PREVIOUS	 5
-#define MK_STOP		 6
-#define MK_TOGGLE	 7
-#define MK_MUTE		 8
-#define MK_VOL_UP	 9
-#define MK_VOL_DOWN	10
-
-// Type define for a keyscan report which contains data identifying any current keypresses.
-// See comments below for a breakdown of this struct.
+// Max number of simultaneous consumer (media) key-presses.
+#define MAX_CONSUMER_KEYS	4
+
+// Keys that can be down besides the MAX_KEYS in the report (every matrix key and combo).  Whilst any are, the report holds
+// error-rollover codes instead of keys.
+#define KEYSCAN_OVERFLOW	(MATRIX_KEYS + MAX_COMBOS - MAX_KEYS)
+
+// Type define for a keyscan report which contains data identifying any current keypresses.  The report is kept up to date by
+// handle_key() as keys go down and up, rather than rebuilt from every key on each scan.  See comments below for a breakdown of this
+// struct.
 typedef struct
 {
-	uint16_t media_keys;
+	uint16_t consumer_keys[MAX_CONSUMER_KEYS];
 	uint8_t modifier;
 	uint8_t keys[MAX_KEYS];
+	bool keys_changed;		// The modifier or keys have changed since the keyboard report was last sent.
+	bool consumer_changed;		// The consumer keys have changed since the media controller report was last sent.
 } keyscan_report_t;
 
+// Type define for scanner diagnostics.
+typedef struct
+{
+	uint16_t row_settle_cycles;	// Worst-case cpu cycles for a driven row to read back low (see keyscan_calibrate()).
+	uint16_t recovery_faults;	// Number of times the columns of a row had not recovered within KEYSCAN_SETTLE_CYCLES.
+} keyscan_stats_t;
+
+extern keyscan_stats_t keyscan_stats;
+extern keyscan_report_t keyscan_report;
+extern matrix_row_t matrix[MATRIX_ROWS];
+
 // Function declarations.
 void keyscan_init(void);
-void handle_key(char key, keyscan_report_t *keyscan_report);
-void create_keyscan_report(keyscan_report_t *keyscan_report);
-const macro_t *scan_macro_keys(void);
+void keyscan_calibrate(void);
+void keyscan_sample_matrix(matrix_row_t *samples);
+void handle_key(keycode_t key, bool pressed);
+bool create_keyscan_report(void);
 uint8_t char_to_code(char key);
 bool upper_case_check(char key);
 
@@ -49,24 +87,11 @@ lsb	bit0	Left Control
 	bit6	Right Alt
 msb	bit7	Right Gui
 
-keys[6]: each key is represented by a byte 0x00 to 0x65.
-A maximum of six simultaneous key presses will be registered.
-
-media_keys: 11 bits each represent the state of a media key:
-lsb	bit00	Play 
-	bit01	Pause 
-	bit02	Fast Forward 
-	bit03	Rewind 
-	bit04	Next Track 
-	bit05	Previous Track 
-	bit06	Stop 
-	bit07	Play/Pause (toggle) 
-	bit08	Mute 
-	bit09	Volume Up 
-	bit10	Volume Down 
-	bit11	n/a (ignored)
-	bit12	n/a (ignored)
-	bit13	n/a (ignored)
-	bit14	n/a (ignored)
-msb	bit15	n/a (ignored)
+keys[6]: each key is represented by a byte 0x00 to 0x65, or 0x00 for an empty slot.  A key keeps its slot for as long as it is
+held.  If more than six keys are held, every slot holds 0x01 (error-rollover) until no more than six are.
+
+consumer_keys[4]: each consumer key is represented by its 16-bit consumer page usage (e.g. 0x00E9 for Volume Up), or 0x0000 for an
+empty slot.  As with keys[], a usage keeps its slot for as long as it is held.  A maximum of four will be registered.
 */
+
+#endif
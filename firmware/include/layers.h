@@ -0,0 +1,23 @@
+#ifndef _LAYERS_H_
+#define _LAYERS_H_
+
+#include <avr/io.h>
+#include <stdbool.h>	// Needed for using true/false booleans.
+#include "keymap.h"
+
+// Bitmask of layers, bit n set for layer n.
+typedef uint8_t layer_state_t;
+
+// Declarations:
+void layers_init(void);
+keycode_t layers_peek(uint8_t key);
+keycode_t layers_resolve(uint8_t key);
+keycode_t layers_keycode(uint8_t key);
+void layers_on(uint8_t layer);
+void layers_off(uint8_t layer);
+void layers_toggle(uint8_t layer);
+void layers_oneshot(uint8_t layer);
+void layers_oneshot_clear(void);
+layer_state_t layers_state(void);
+
+#endif
@@ -1,6 +1,12 @@
+#ifndef _LEDS_H_
+#define _LEDS_H_
+
 #include <avr/io.h>
-#include <stdbool.h>	// Needed for using true/false booleans.
-#include <util/delay.h>	// Needed for using _delay_ms() function.
+#include <avr/pgmspace.h>	// Needed for the effect tables.
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include <string.h>		// Needed for memcpy_P.
+#include <util/atomic.h>	// Needed as effects are requested from outside the system tick interrupt.
+#include <util/delay.h>		// Needed for using _delay_ms() function.
 
 // Definitions used for initiatilising and controling the led control button. 
 #define BUTTON_PIN		PB5		// PB5 is also PCINT0 - Pin Change Interrupt Pin 0
@@ -14,54 +20,89 @@
 #define BUTTON_PCI_VECTOR	PCINT0_vect	// Pin-change Interrupt sub-routine vector.
 #define BUTTON_DEBOUNCE_MS	20		// Button de-bounce duration in milliseconds.
 
-// Definitions used for initiatilising and controling the pwm output pin. 
-#define PWM_PIN		PB7	// The pin to which the PWM signal will be connected.
+// Definitions used for initiatilising and controling the pwm output pin.  The backlight is driven by the 16-bit Timer1 in fast pwm
+// mode straight from clk_I/O (no timer prescaler), with LEDS_PWM_BITS of resolution: 12 bits gives 16MHz / 4096 = 3.9kHz, well clear
+// of visible (or camera) flicker, with 4096 steps for smooth dimming at the low end.
+#define PWM_PIN		PB7	// The pin to which the PWM signal will be connected (OC1C).
 #define PWM_PORT	PORTB	// The port register that includes the pwm pin.
 #define PWM_DDR		DDRB	// Data direction register that corresponds to the relevant port.
-#define PWM_SET		OCR0A	// Output compare register (writing 8-bits to here sets the pulse-width).
-#define PWM_TCCRA	TCCR0A	// Timer/Counter Control Register A
-#define PWM_TCCRB	TCCR0B	// Timer/Counter Control Register B
-#define PWM_COM0	COM0A0	// Compare Output Mode Bit 0
-#define PWM_COM1	COM0A1	// Compare Output Mode Bit 1
-#define PWM_WGM0	WGM00	// Waveform Generation Mode Bit 0
-#define PWM_WGM1	WGM01	// Waveform Generation Mode Bit 1
-#define PWM_WGM2	WGM02	// Waveform Generation Mode Bit 2
-#define PWM_CS0		CS00	// Clock Select Bit 0
-#define PWM_CS1		CS01	// Clock Select Bit 1
-#define PWM_CS2		CS02	// Clock Select Bit 2
+#define PWM_SET		OCR1C	// Output compare register (writing up to LEDS_PWM_BITS bits to here sets the pulse-width).
+#define PWM_TOP		ICR1	// Input capture register, used as the TOP of the count.
+#define PWM_COUNT	TCNT1	// Timer/Counter Register
+#define PWM_TCCRA	TCCR1A	// Timer/Counter Control Register A
+#define PWM_TCCRB	TCCR1B	// Timer/Counter Control Register B
+#define PWM_COM0	COM1C0	// Compare Output Mode Bit 0
+#define PWM_COM1	COM1C1	// Compare Output Mode Bit 1
+#define PWM_WGM0	WGM10	// Waveform Generation Mode Bit 0
+#define PWM_WGM1	WGM11	// Waveform Generation Mode Bit 1
+#define PWM_WGM2	WGM12	// Waveform Generation Mode Bit 2
+#define PWM_WGM3	WGM13	// Waveform Generation Mode Bit 3
+#define PWM_CS0		CS10	// Clock Select Bit 0
+#define LEDS_PWM_BITS	12					// Resolution of the pwm.
+#define LEDS_PWM_MAX	((1 << LEDS_PWM_BITS) - 1)		// Full brightness.
+#define LEDS_SLOW_SHIFT	3					// Bits of resolution given up whilst the cpu clock is divided by 8.
+
+// The pulse effect is advanced by leds_tick(), every millisecond from the system tick interrupt, by pulse_speed steps of the pwm.
+
+// Reactive effects.  On top of the brightness (or pulse) of the mode, the backlight reacts to what the keypad and host are doing:
+// a flash on each key press that decays back to the mode's brightness, a blink whilst a macro plays, one blink when Num Lock or
+// Caps Lock goes off and two when one goes on, and a fade to LEDS_IDLE_LEVEL once the keys have been idle for LEDS_IDLE_MS.  The
+// key pipeline, macro player and LED report only note what happened (leds_key(), leds_macro() and leds_lock_echo()) - each effect
+// is a sequence of steps in a table, played by leds_tick() from the system tick, so nothing is added to the scan or report path.
+// Only one effect plays at a time: a request for an effect of the same or higher number (priority) replaces the one playing.  Each
+// effect can be turned off in settings.led_effects (see the vendor interface), and none play whilst the mode is off.
+#define LEDS_EFFECT_NONE	0
+#define LEDS_EFFECT_FADE	1	// Fade to LEDS_IDLE_LEVEL and stay there until a key is pressed.
+#define LEDS_EFFECT_KEY		2	// Flash on a key press.
+#define LEDS_EFFECT_MACRO	3	// Blink whilst a macro plays.
+#define LEDS_EFFECT_LOCK_OFF	4	// Num Lock or Caps Lock went off.
+#define LEDS_EFFECT_LOCK_ON	5	// Num Lock or Caps Lock went on.
+#define LEDS_NUM_EFFECTS	6
+#define LEDS_EFFECTS_ALL	0x3E	// Bit n of settings.led_effects enables effect n.
+
+#define LEDS_IDLE_MS		60000	// Idle time before the fade (up to 65534).
+#define LEDS_IDLE_LEVEL		0	// Brightness faded to.
+#define LEDS_LEVEL_BASE		0xFFFF	// In a step, the brightness of the mode.
 
-// Definitions used for initiatilising and controling the pulse timer. 
-#define PULSER_TCCRA		TCCR1A			// Timer/Counter Control Register A
-#define PULSER_TCCRB		TCCR1B			// Timer/Counter Control Register B
-#define PULSER_WGM3		WGM13			// Timer/Counter Waveform Generation Mode Bit 3
-#define PULSER_WGM2		WGM12			// Timer/Counter Waveform Generation Mode Bit 2
-#define PULSER_WGM1		WGM11			// Timer/Counter Waveform Generation Mode Bit 1
-#define PULSER_WGM0		WGM10			// Timer/Counter Waveform Generation Mode Bit 0
-#define PULSER_CS2		CS12			// Timer/Counter Clock Select Bit 2
-#define PULSER_CS1		CS11			// Timer/Counter Clock Select Bit 1
-#define PULSER_CS0		CS10			// Timer/Counter Clock Select Bit 0
-#define PULSER_SET_REG		OCR1A			// Timer/Counter Output Compare Register
-#define PULSER_TIMSK		TIMSK1			// Timer/Counter Timer Interrupt Mask Register
-#define PULSER_IE		OCIE1A			// Timer Output Compare Interrupt Enable Bit.
-#define PULSER_INT_VECTOR	TIMER1_COMPA_vect	// Interrupt subroutine name.
+// A step of an effect: a straight line from the brightness at the end of the last step to level, over ms milliseconds (0 jumps).
+typedef struct
+{
+	uint16_t level;
+	uint16_t ms;
+} leds_step_t;
+
+// An effect: its steps in the step table and whether it repeats them until replaced.
+typedef struct
+{
+	uint8_t first;
+	uint8_t count;
+	bool repeat;
+} leds_effect_t;
 
 // Mode definitions.
 #define NUM_MODES	(sizeof(modes) / sizeof modes[0])	// Macro for returning the total number of modes.
-#define START_MODE	4					// The led mode at start-up.
+#define START_MODE	4					// The led mode at start-up, until another is saved.
 
 // Declarations:
 struct mode
 {
-	uint8_t initial_brightness;
-	uint16_t pulse_speed;
+	uint16_t initial_brightness;
+	uint8_t pulse_speed;
 };
 void leds_init(void);
-void leds_pwm_set(uint8_t duty);
-uint8_t leds_pwm_get(void);
-void leds_pulse_enable(bool enable);
-void leds_pulse_speed_set(uint16_t speed);
+void leds_pwm_set(uint16_t duty);
+uint16_t leds_pwm_get(void);
+void leds_pulse_speed_set(uint8_t speed);
 void leds_set_mode(uint8_t mode);
-void leds_handle_pulser_interrupt(void);
+void leds_tick(void);
+void leds_key(void);
+void leds_macro(bool running);
+void leds_lock_echo(bool on);
 void leds_change_mode(void);
 void leds_button_enable(bool enable);
+void leds_button_changed(void);
+void leds_button_task(void);
 bool leds_button_state(void);
+void leds_slow_clock(bool slow);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _MACROPLAY_H_
+#define _MACROPLAY_H_
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>	// Needed for reading macros from flash.
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include "keyscan.h"
+#include "systick.h"
+#include "zstring.h"
+
+// The macro player.  Macros play in the background, a few at a time, so that a macro pausing on an M_WAIT does not stop the
+// keyboard or other macros.  Each macro started runs in one of MACRO_SLOTS slots until its M_NULL.  Once per USB frame each busy
+// slot is given a turn, round-robin, starting one slot further on each frame.
+//
+// Only one slot at a time can type.  A slot that reaches a typing action (M_STRING, M_ZSTRING or M_KEYS) takes the keyboard
+// report if no other slot has it, and keeps it until it reaches an M_WAIT or the end of its macro.  Other slots queue at their
+// next typing action until then, so the actions of two macros interleave but their text never does.  Whilst a slot has the
+// keyboard report the host sees only the macro's keys, and the key event pipeline waits for the keyboard to be handed back.
+#define MACRO_SLOTS	4
+
+// Pacing.  Hosts behind a virtual machine, a remote desktop or a slow login prompt can drop characters typed at the full USB rate,
+// so how fast a macro types is set by a pace: the number of frames between the reports it sends (at least 1 - a report every frame
+// is as fast as the keyboard endpoint goes), and a gap in milliseconds after each character or combination of keys is released.
+// Every macro starts at the global pace, settings.macro_pace (which the host can change over the vendor interface), and an M_PACE
+// action sets the pace for the rest of that macro.  A calibrate action in the keymap description (see demo.km) types a test line at
+// a series of paces, so the fastest pace a host keeps up with can be read off its screen.
+#define MACRO_PACE_FRAMES	1	// Default pace: a report every frame (two frames per character),
+#define MACRO_PACE_GAP_MS	0	// with no gap.
+
+typedef struct
+{
+	uint8_t frames;		// Frames from one report to the next (1 to 255).
+	uint8_t gap_ms;		// Pause after each character or combination of keys.
+} macro_pace_t;
+
+// Declarations:
+void macroplay_init(void);
+bool macroplay_start(const macro_t *macro);
+bool macroplay_busy(void);
+void macroplay_frame(void);
+void macroplay_task(void);
+bool macroplay_typing(void);
+bool macroplay_report_pending(void);
+bool macroplay_fill_report(uint8_t *modifier, uint8_t keys[MAX_KEYS]);
+void macroplay_report_sent(void);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef _MACROSTORE_H_
+#define _MACROSTORE_H_
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>	// Needed for reading the store.
+#include <avr/boot.h>		// Needed for self-programming the store.
+#include <avr/eeprom.h>		// Needed for eeprom_busy_wait (SPM must not overlap an EEPROM write).
+#include <avr/interrupt.h>	// Needed for cli.
+#include <util/crc16.h>		// Needed for the store checksum.
+#include <string.h>		// Needed for memset/memcpy.
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include "keymap.h"
+
+// The macro store is a region of application flash holding macros that the host can rewrite over the vendor interface (see
+// vendor.h), for macros too large for EEPROM or that change without a firmware update.  Stored macros are played with SMACRO(n) in
+// the keymap, exactly as MACRO(n) plays the compiled-in macros.
+//
+// The region is two banks.  The host always writes the bank that is not in use, a page at a time, and the new macros are only
+// switched to when the whole bank has been written and its checksum matches - so a transfer that is cut short never touches the
+// macros being played.  The first page of each bank is a header (written last), the rest is the macro image.
+//
+// The host's requests only fill a page buffer in RAM.  Each full page is erased and written by macrostore_task() from the main loop,
+// a step per pass, with the requests that need the buffer replying MACROSTORE_BUSY until it is free again.  Each step still stops
+// the cpu (and with it the system tick and usb) for about 4ms.
+//
+// Flash can only be written by the SPM instruction running from the boot section, so the page functions are linked into the
+// .spm section at SPM_SECTION_START (see the makefile).  The BOOTSZ fuses must give a boot section of at least 256 words and BOOTRST
+// must be unprogrammed (the firmware is flashed by ISP, so no bootloader is needed).  The application must end below
+// MACROSTORE_START - the makefile checks this after linking, against its own copy passed in as MACROSTORE_LIMIT.
+#define SPM_SECTION_START	0x7E00						// Smallest (256 word) boot section.
+#define MACROSTORE_BANK_PAGES	32						// 4KB per bank.
+#define MACROSTORE_BANK_SIZE	(MACROSTORE_BANK_PAGES * SPM_PAGESIZE)
+#define MACROSTORE_START	(SPM_SECTION_START - (2 * MACROSTORE_BANK_SIZE))
+#if defined(MACROSTORE_LIMIT) && (MACROSTORE_START != MACROSTORE_LIMIT)
+#error "MACROSTORE_START does not match the makefile."
+#endif
+#define MACROSTORE_DATA_SIZE	(MACROSTORE_BANK_SIZE - SPM_PAGESIZE)		// Bytes of macro image per bank.
+#define MACROSTORE_MAGIC	0x534D						// Marks a committed bank ("MS").
+#define MACROSTORE_NONE		0xFF						// No bank in use.
+#define MACROSTORE_PIECE_MAX	32						// Longest piece of image macrostore_data() takes.
+
+// Bank header.
+typedef struct
+{
+	uint16_t magic;
+	uint16_t sequence;	// Incremented on each commit - the valid bank with the later sequence is used.
+	uint16_t length;	// Bytes of macro image.
+	uint16_t crc;		// CRC-16 of the macro image.
+} macrostore_header_t;
+
+// The macro image starts with the number of macros and the offset (from the start of the image) of each.  Each macro is packed
+// byte-code as described in keymap.h.  M_ZSTRING actions refer to the compiled-in macro text.
+typedef struct
+{
+	uint8_t count;
+	uint8_t reserved;
+	uint16_t offsets[];
+} macrostore_image_t;
+
+// Status codes (shared with the vendor interface replies).
+#define MACROSTORE_OK		0
+#define MACROSTORE_BAD_ARG	2
+#define MACROSTORE_BAD_CRC	4
+#define MACROSTORE_BUSY		5	// A page is still being written (or a macro is playing) - try again.
+
+// Declarations:
+void macrostore_init(void);
+const macro_t *macrostore_macro(uint8_t n);
+uint8_t macrostore_bank(void);
+const macrostore_header_t *macrostore_header(uint8_t bank);
+uint8_t macrostore_begin(uint16_t length);
+uint8_t macrostore_data(uint16_t offset, const uint8_t *data, uint8_t count);
+uint8_t macrostore_commit(uint16_t crc);
+void macrostore_task(void);
+void macrostore_erase_page(uint16_t address) __attribute__((section(".spm"), noinline));
+void macrostore_write_page(uint16_t address, const uint8_t *data) __attribute__((section(".spm"), noinline));
+
+#endif
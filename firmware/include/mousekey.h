@@ -0,0 +1,53 @@
+#ifndef _MOUSEKEY_H_
+#define _MOUSEKEY_H_
+
+#include <avr/io.h>
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include <util/atomic.h>	// Needed as the pointer is moved by the system tick interrupt.
+
+// Mouse keys.  Keys in the keymap (MS_* in keymap.h) move the pointer, press the mouse buttons and turn the wheel, through a mouse
+// HID interface of its own with a 1ms polling interval.  Whilst a direction key is held the pointer speeds up along an acceleration
+// curve, worked out in fixed point every millisecond by mousekey_tick() from the system tick interrupt, which adds the motion up in
+// whole pixels.  The report is sent by the main loop (SendNextMouseReport()) only whilst there is motion to send or the buttons have
+// changed, so the keyboard and media controller reports are not held up, and the pointer moves smoothly at the full USB rate.
+//
+// Speeds are in 1/256 pixel per millisecond (256 is 1000 pixels a second).  The curve, in the settings (and set over the vendor
+// interface), is one of:
+#define MOUSEKEY_CONSTANT	0	// Move at the top speed straight away.
+#define MOUSEKEY_LINEAR		1	// Start at the start speed, and add accel/256 to the speed every millisecond.
+#define MOUSEKEY_EXPONENTIAL	2	// Start at the start speed, and grow the speed by accel/65536 of itself every millisecond.
+#define MOUSEKEY_CURVES		3
+
+// Default curve: a linear ramp from 250 to 3000 pixels a second over about 0.8 seconds.
+#define MOUSEKEY_DEFAULT	{ .curve = MOUSEKEY_LINEAR, .start = 64, .max = 768, .accel = 225 }
+
+// The wheel turns a step when its key goes down, then every MOUSEKEY_WHEEL_MS whilst it is held.
+#define MOUSEKEY_WHEEL_MS	60
+
+// Mouse keys (the argument of the MS_* keycodes in keymap.h).
+#define MOUSEKEY_UP		0
+#define MOUSEKEY_DOWN		1
+#define MOUSEKEY_LEFT		2
+#define MOUSEKEY_RIGHT		3
+#define MOUSEKEY_BUTTON1	4	// Left button.
+#define MOUSEKEY_BUTTON2	5	// Right button.
+#define MOUSEKEY_BUTTON3	6	// Middle button.
+#define MOUSEKEY_WHEEL_UP	7
+#define MOUSEKEY_WHEEL_DOWN	8
+#define MOUSEKEY_KEYS		9
+
+typedef struct
+{
+	uint8_t curve;		// MOUSEKEY_CONSTANT, MOUSEKEY_LINEAR or MOUSEKEY_EXPONENTIAL.
+	uint16_t start;		// Speed when a direction key goes down (1 to max).
+	uint16_t max;		// Top speed (1 to 32767).
+	uint16_t accel;		// Speed-up every millisecond (see the curves).
+} mousekey_profile_t;
+
+// Declarations:
+void mousekey_key(uint8_t key, bool pressed);
+void mousekey_tick(void);
+bool mousekey_take(uint8_t *buttons, int8_t *x, int8_t *y, int8_t *wheel);
+bool mousekey_profile_valid(const mousekey_profile_t *profile);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>	// Needed for the probe names.
+#include <string.h>		// Needed for memset.
+#include <util/atomic.h>	// Needed for updating and reading the probe table atomically.
+#include "systick.h"
+
+// Cycle profiler.  Built with make PROFILE=1, a probe at the top of each of the key stages counts the calls to that stage and the
+// cpu cycles spent in it (from entry to return, whichever return it takes) into a fixed table, which the host reads over the vendor
+// interface (see vendor.h).  Cycles are counted with the system tick timer (systick_cycles()), so they are accurate to within
+// SYSTICK_PRESCALER cycles, and include any interrupts taken and any other probed stages called along the way.  Without PROFILE
+// the probes compile to nothing.
+//
+// Interrupt probes (PROFILE_ISR_PROBE) only read the timer count, so they also work in the system tick interrupt itself, and can
+// only time an interrupt shorter than a tick.  The button interrupt is not probed, as all it does is note the change of the pin.
+
+// Probes:
+#define PROBE_HID_TASK		0	// HID_Task() - the whole of a pass of the main loop bar the lufa USB task.
+#define PROBE_SCAN		1	// create_keyscan_report()
+#define PROBE_HANDLE_KEY	2	// handle_key()
+#define PROBE_KEYBOARD_CREATE	3	// CreateKeyboardReport()
+#define PROBE_KEYBOARD_SEND	4	// SendNextKeyboardReport()
+#define PROBE_MEDIA_SEND	5	// SendNextMediaControllerReport()
+#define PROBE_LEDS_RECEIVE	6	// ReceiveNextKeyboardReport()
+#define PROBE_SYSTICK_ISR	7	// The system tick interrupt (including the led effects and mouse keys it runs every millisecond).
+#define PROBE_MOUSE_SEND	8	// SendNextMouseReport()
+#define PROFILE_NUM_PROBES	9
+
+// Longest probe name (see profile.c), not counting the terminating null.
+#define PROFILE_NAME_MAX	15
+
+// Counters of a probe.
+typedef struct
+{
+	uint32_t calls;		// Times the stage has run.
+	uint32_t cycles;	// Cycles spent in it altogether.
+	uint32_t max_cycles;	// Longest single run.
+} profile_probe_t;
+
+// A probe in use - which one it is and when it was entered.
+typedef struct
+{
+	uint8_t probe;
+	uint32_t start;
+} profile_scope_t;
+
+#ifdef PROFILE
+// Time the rest of the enclosing function (or block) with the given probe.
+#define PROFILE_PROBE(probe)		profile_scope_t _profile_scope __attribute__((cleanup(profile_leave))) = {(probe), systick_cycles()}
+#define PROFILE_ISR_PROBE(probe)	profile_scope_t _profile_scope __attribute__((cleanup(profile_leave_isr))) = {(probe), SYSTICK_COUNT}
+#else
+#define PROFILE_PROBE(probe)
+#define PROFILE_ISR_PROBE(probe)
+#endif
+
+// Declarations:
+void profile_leave(profile_scope_t *scope);
+void profile_leave_isr(profile_scope_t *scope);
+void profile_read(uint8_t probe, profile_probe_t *counters);
+const char *profile_name(uint8_t probe);
+void profile_reset(void);
+
+#endif
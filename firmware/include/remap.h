@@ -0,0 +1,45 @@
+#ifndef _REMAP_H_
+#define _REMAP_H_
+
+#include <avr/io.h>
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include <avr/pgmspace.h>	// Needed for copying the keymap from flash.
+#include <avr/eeprom.h>		// Needed for the stored overrides.
+#include <string.h>		// Needed for memcpy_P.
+#include "keymap.h"
+
+// Runtime keymap overrides.  The compiled-in KEYMAPS are copied into keymap_ram at boot and any overrides stored in EEPROM are
+// applied on top.  The layer engine only ever reads keymap_ram, so the scan path never touches flash tables or EEPROM.  Overrides
+// are set by the host through the vendor interface (see vendor.h).
+//
+// An override is used in RAM straight away and queued for EEPROM, which remap_task() writes in the background a byte per pass of the
+// main loop as the EEPROM is ready (so a usb request never waits ~3.4ms a byte on it).  The writes are ordered so that a reset part
+// way through never loads a half-written override: a new entry is only counted once all four bytes are in, and an entry being
+// changed has its key marked REMAP_NO_KEY (so it is skipped) until its new keycode is in.
+#define REMAP_MAX_OVERRIDES	64		// 4 bytes of EEPROM each.
+#define REMAP_QUEUE		8		// Overrides waiting to be written.
+#define REMAP_MAGIC		0x4B52		// Marks the EEPROM override table as initialised ("RK").
+#define REMAP_NO_KEY		0xFF		// Key of an entry being changed - never a key of the matrix.
+
+// Status codes returned by remap_set().  Shared with the vendor interface replies.
+#define REMAP_OK		0
+#define REMAP_BAD_ARG		2
+#define REMAP_FULL		3
+#define REMAP_BUSY		5	// Too many overrides are waiting to be written - try again.
+
+// A stored override.
+typedef struct
+{
+	uint8_t layer;
+	uint8_t key;
+	keycode_t keycode;
+} remap_entry_t;
+
+// Declarations:
+void remap_init(void);
+uint8_t remap_set(uint8_t layer, uint8_t key, keycode_t keycode);
+void remap_reset(void);
+uint8_t remap_count(void);
+void remap_task(void);
+
+#endif
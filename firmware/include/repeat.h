@@ -0,0 +1,48 @@
+#ifndef _REPEAT_H_
+#define _REPEAT_H_
+
+#include <avr/io.h>
+#include <stdbool.h>	// Needed for using true/false booleans.
+#include "keyscan.h"
+#include "systick.h"
+
+// Typematic auto-repeat.  A key held down repeats at a rate set by the firmware, rather than by the host's repeat settings (which
+// are slow on some systems, and do nothing at all for macros).  Like a typewriter keyboard, only the newest repeatable key pressed
+// repeats; keys that do not repeat (modifiers, layer keys and the like) can be pressed without stopping it.
+//
+// Each repeat releases the key and presses it again through the key event pipeline, as resolved events, so a repeat goes through
+// the same macros and reports as a key typed by hand (and the host, seeing the key go up, never starts its own repeat).  The key
+// goes back down as the keycode it was first pressed as, so layers turned on or off since (and any one-shot layer waiting for the
+// next key) leave it be.  The press waits until the release has reached the host - in the media controller report as well, for a
+// consumer key.  A repeating macro key starts its macro again once the last one has finished playing.
+//
+// How a key repeats is set by its class.  Each class has a profile, kept in the settings (and set over the vendor interface): the
+// delay before the first repeat, the interval between the first two repeats, and an acceleration - the interval shortens by
+// accel_ms with every repeat, down to min_interval_ms.  A delay of 0 turns repeat off for the class.
+#define REPEAT_KEYS		0	// Keyboard keys (letters, numbers, the keypad, arrows, ...).
+#define REPEAT_CONSUMER		1	// Consumer keys (volume, brightness, ...).
+#define REPEAT_MACROS		2	// Macro keys.
+#define REPEAT_CLASSES		3
+#define REPEAT_NONE		0xFF	// Keys that never repeat.
+
+// Default profiles:
+#define REPEAT_KEYS_DEFAULT		{ .delay_ms = 300, .interval_ms = 33, .min_interval_ms = 15, .accel_ms = 1 }	// 30 to 66 a second.
+#define REPEAT_CONSUMER_DEFAULT		{ .delay_ms = 400, .interval_ms = 60, .min_interval_ms = 30, .accel_ms = 2 }
+#define REPEAT_MACROS_DEFAULT		{ .delay_ms = 500, .interval_ms = 100, .min_interval_ms = 100, .accel_ms = 0 }
+
+typedef struct
+{
+	uint16_t delay_ms;		// From the press to the first repeat (0 for no repeat).
+	uint8_t interval_ms;		// From the first repeat to the second (at least 1).
+	uint8_t min_interval_ms;	// Shortest interval (1 to interval_ms).
+	uint8_t accel_ms;		// Taken off the interval with each repeat.
+} repeat_profile_t;
+
+// Declarations:
+void repeat_init(void);
+void repeat_pressed(uint8_t key, keycode_t keycode, uint8_t role);
+void repeat_released(uint8_t key);
+void repeat_task(uint16_t now);
+bool repeat_profile_valid(const repeat_profile_t *profile);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef _SETTINGS_H_
+#define _SETTINGS_H_
+
+#include <avr/io.h>
+#include <avr/eeprom.h>		// Needed for the settings journal.
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include <stddef.h>		// Needed for offsetof.
+#include <string.h>		// Needed for memcmp.
+#include <util/atomic.h>	// Needed as settings can be changed from interrupts.
+#include <util/crc16.h>		// Needed for the record checksum.
+#include "macroplay.h"
+#include "repeat.h"
+#include "mousekey.h"
+#include "systick.h"
+
+// Runtime settings.  The settings in use live in RAM (settings), and are loaded at boot from a journal in EEPROM: a ring of
+// SETTINGS_RECORDS records, each a sequence number, a copy of the settings and a CRC-16.  Every save appends a record in the next
+// slot of the ring, so the cells wear evenly, and the newest record with a good CRC is the one loaded (a record cut short by a reset
+// fails its CRC, and the one before it is loaded instead).
+//
+// Changing a setting only marks the settings as changed - settings_changed() is safe to call from anywhere, including interrupts.
+// The record is written in the background by settings_task() a byte at a time, once nothing has changed for SETTINGS_DELAY_MS (so a
+// run of changes, e.g. stepping through the led modes, is saved once) and only if the settings differ from the last record.
+#define SETTINGS_RECORDS	16		// Records in the ring - 30 bytes of EEPROM each.
+#define SETTINGS_DELAY_MS	3000		// Quiet time before a change is saved.
+#define SETTINGS_MAGIC		0x5334		// Starts the CRC of each record ("S4").  Change it whenever settings_t changes.
+
+// The settings.
+typedef struct
+{
+	uint8_t led_mode;		// Backlight mode (see leds.c).
+	uint8_t led_effects;		// Reactive backlight effects turned on (see leds.h).
+	macro_pace_t macro_pace;	// The pace every macro starts at (see macroplay.h).
+	repeat_profile_t repeat[REPEAT_CLASSES];	// How each class of key auto-repeats (see repeat.h).
+	mousekey_profile_t mouse;	// How the mouse keys speed up (see mousekey.h).
+} settings_t;
+
+// A record of the journal.
+typedef struct
+{
+	uint16_t sequence;	// One more than the record before it.
+	settings_t settings;
+	uint16_t crc;		// CRC-16 of the sequence and settings, starting from SETTINGS_MAGIC.
+} settings_record_t;
+
+extern settings_t settings;
+
+// Declarations:
+void settings_init(void);
+void settings_changed(void);
+void settings_task(void);
+
+#endif
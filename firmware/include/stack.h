@@ -0,0 +1,35 @@
+#ifndef _STACK_H_
+#define _STACK_H_
+
+#include <avr/io.h>
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include <util/atomic.h>	// Needed as interrupts push onto the stack being repainted.
+
+// RAM and stack use.  The 2.5kB of SRAM holds the static variables at the bottom (.data, .bss and .noinit, ending at _end) and the
+// stack, growing down from RAMEND towards them - nothing uses a heap.  Report structs, vendor buffers and the lufa control request
+// handling all live on the stack, and any interrupt can land on top of the deepest of them, so how deep the stack goes is hard to
+// tell from the code.
+//
+// So before main() runs, stack_paint() fills all of the RAM between _end and the stack with STACK_CANARY.  Whatever the stack has
+// ever reached has been overwritten, so the canary left at the bottom of that space is the headroom the stack has never touched, and
+// RAMEND less the lowest byte overwritten is its high-water mark.  stack_read() (over the vendor interface, see vendor.h) reports it
+// along with the size of each section of static RAM; stack_repaint() paints the free space again to measure from a given point on.
+// For a breakdown of the static RAM by variable, "make ram" lists the largest.
+#define STACK_CANARY	0xC5
+
+typedef struct
+{
+	uint16_t ram;		// Size of the SRAM.
+	uint16_t data;		// Initialised static variables (.data).
+	uint16_t bss;		// Zeroed static variables (.bss).
+	uint16_t noinit;	// Static variables left as they were at reset (.noinit).
+	uint16_t stack_peak;	// The deepest the stack has been since it was painted.
+	uint16_t stack_now;	// The depth of the stack when read.
+	uint16_t headroom;	// Bytes the stack has never reached - what is left for more static RAM or deeper calls.
+} stack_stats_t;
+
+// Declarations:
+void stack_read(stack_stats_t *stats);
+void stack_repaint(void);
+
+#endif
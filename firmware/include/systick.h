@@ -0,0 +1,41 @@
+#ifndef _SYSTICK_H_
+#define _SYSTICK_H_
+
+#include <avr/io.h>
+#include <stdbool.h>		// Needed for using true/false booleans.
+#include <util/atomic.h>	// Needed for reading the 16-bit tick counters atomically.
+
+// The system tick is a free-running time base used for scan scheduling and anything else that needs to measure time without
+// blocking.  It is generated by Timer3 (otherwise unused) in CTC mode.
+#define SYSTICK_HZ		4000				// Tick rate.  Also the fastest possible scan rate.
+#define SYSTICK_TICKS_PER_MS	(SYSTICK_HZ / 1000)		// Number of ticks per millisecond.
+
+// Definitions used for initiatilising the tick timer.
+#define SYSTICK_TCCRA		TCCR3A			// Timer/Counter Control Register A
+#define SYSTICK_TCCRB		TCCR3B			// Timer/Counter Control Register B
+#define SYSTICK_WGM2		WGM32			// Timer/Counter Waveform Generation Mode Bit 2
+#define SYSTICK_CS1		CS31			// Timer/Counter Clock Select Bit 1
+#define SYSTICK_CS0		CS30			// Timer/Counter Clock Select Bit 0
+#define SYSTICK_SET_REG		OCR3A			// Timer/Counter Output Compare Register
+#define SYSTICK_COUNT		TCNT3			// Timer/Counter Register
+#define SYSTICK_TIFR		TIFR3			// Timer/Counter Interrupt Flag Register
+#define SYSTICK_IF		OCF3A			// Output Compare Flag (set until the tick interrupt runs).
+#define SYSTICK_TIMSK		TIMSK3			// Timer/Counter Timer Interrupt Mask Register
+#define SYSTICK_IE		OCIE3A			// Timer Output Compare Interrupt Enable Bit.
+#define SYSTICK_INT_VECTOR	TIMER3_COMPA_vect	// Interrupt subroutine name.
+#define SYSTICK_PRESCALER	8			// Must match the clock select bits set in systick_init().
+#define SYSTICK_TOP		(((F_CPU / SYSTICK_PRESCALER) / SYSTICK_HZ) - 1)	// The timer counts from 0 to this each tick.
+
+// systick_cycles() counts cpu cycles at full speed (in steps of SYSTICK_PRESCALER) from the tick count and the timer count.  It
+// wraps along with the tick counter, after SYSTICK_CYCLES_WRAP cycles (about 16 seconds).
+#define SYSTICK_CYCLES_WRAP	((uint32_t)65536 * (SYSTICK_TOP + 1) * SYSTICK_PRESCALER)
+
+// Declarations:
+void systick_init(void);
+bool systick_handle_interrupt(void);
+uint16_t systick_ticks(void);
+uint16_t systick_ms(void);
+uint32_t systick_cycles(void);
+void systick_slow_clock(bool slow);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _TAPHOLD_H_
+#define _TAPHOLD_H_
+
+#include <avr/io.h>
+#include <string.h>	// Needed for memcpy/memmove.
+#include <stdbool.h>	// Needed for using true/false booleans.
+#include "events.h"
+
+// Dual-role keys (LT and MT in keymap.h) are undecided when they go down.  Whilst undecided, every following key event is held
+// back in a buffer.  The key is decided as a hold once TAPPING_TERM_MS passes, or as a tap if it is released first, then the
+// buffered events are released in order.  Keys that are not dual-role pass straight through when nothing is undecided.
+#define TAPPING_TERM_MS		200
+
+// Permissive hold - decide a hold as soon as another key is pressed and released within the tapping term.
+#define PERMISSIVE_HOLD
+
+// Hold on other key press - decide a hold as soon as another key is pressed.  Overrides PERMISSIVE_HOLD.
+//#define HOLD_ON_OTHER_KEY_PRESS
+
+// Number of key events that can be held back.  Once full the undecided key is decided as a hold.
+#define TAPHOLD_BUFFER_SIZE	8
+
+// Declarations:
+void taphold_init(void);
+void taphold_event(uint8_t key, bool pressed, uint16_t time);
+void taphold_task(uint16_t now);
+
+#endif
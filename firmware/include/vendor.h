@@ -0,0 +1,84 @@
+#ifndef _VENDOR_H_
+#define _VENDOR_H_
+
+#include <avr/io.h>
+#include <string.h>	// Needed for memset.
+#include "remap.h"
+#include "macrostore.h"
+#include "macroplay.h"
+#include "profile.h"
+#include "bounce.h"
+#include "settings.h"
+#include "boot.h"
+#include "leds.h"
+#include "stack.h"
+#include "governor.h"
+
+// The vendor interface is a vendor-defined HID interface carrying a single feature report of VENDOR_REPORT_SIZE bytes.  The host
+// sends a command with a set feature report: byte 0 is the command, the rest are its arguments.  It then reads the reply with a get
+// feature report: byte 0 echoes the command, byte 1 is a VENDOR_STATUS_* code and the rest is the reply data.  Multi-byte values are
+// little-endian.
+#define VENDOR_REPORT_SIZE	32
+
+// Commands:
+#define VENDOR_CMD_NOP		0x00	// Does nothing (replies VENDOR_STATUS_OK).
+#define VENDOR_CMD_KEYMAP_INFO	0x10	// Reply: layers, rows, columns, overrides stored, max overrides.
+#define VENDOR_CMD_KEYMAP_GET	0x11	// Args: layer, key.  Reply: keycode (2 bytes).
+#define VENDOR_CMD_KEYMAP_SET	0x12	// Args: layer, key, keycode (2 bytes).  Used straight away and stored in EEPROM in the background
+					// (VENDOR_STATUS_BUSY if too many are still waiting to be stored).
+#define VENDOR_CMD_KEYMAP_RESET	0x13	// Remove every override.
+#define VENDOR_CMD_MACROS_INFO	0x20	// Reply: page size, bank size (2 bytes), bank in use, its sequence (2 bytes) and length (2
+					// bytes).
+#define VENDOR_CMD_MACROS_BEGIN	0x21	// Args: image length (2 bytes).  Starts a new macro store image.
+#define VENDOR_CMD_MACROS_DATA	0x22	// Args: offset (2 bytes), count (up to VENDOR_DATA_MAX), data.  The next piece of the image.
+#define VENDOR_CMD_MACROS_COMMIT	0x23	// Args: CRC-16 of the image (2 bytes).  Checks and switches to the new image.
+					// BEGIN, DATA and COMMIT reply VENDOR_STATUS_BUSY (send them again) whilst a page is being written
+					// to flash in the background, and BEGIN whilst a macro is playing.
+#define VENDOR_CMD_MACROS_PACE	0x24	// Args: frames, gap (ms) - the global macro pace (frames 0 leaves it as is), saved in the
+					// settings.  Reply: the pace.
+// Cycle profiler commands, only in builds with the probes compiled in (see profile.h).  Otherwise they reply VENDOR_STATUS_UNKNOWN.
+#define VENDOR_CMD_PROFILE_INFO	0x30	// Reply: number of probes, cycles per count of the timer, cpu clock in kHz (2 bytes).
+#define VENDOR_CMD_PROFILE_READ	0x31	// Args: probe.  Reply: calls, cycles and longest run in cycles (4 bytes each), then the name.
+#define VENDOR_CMD_PROFILE_RESET	0x32	// Clear the counters of every probe.
+// Bounce profiler and debounce windows (see bounce.h).  Windows and bounce times are in system ticks.
+#define VENDOR_CMD_BOUNCE_START	0x40	// Start the bounce profiler.  Reply: system ticks per millisecond, longest window.
+#define VENDOR_CMD_BOUNCE_STOP	0x41	// Args: tune (1 to tune and store the windows from what was seen).  Reply: keys tuned.
+#define VENDOR_CMD_BOUNCE_READ	0x42	// Args: key.  Reply: edges (2 bytes), chatter, longest bounce, window.
+#define VENDOR_CMD_BOUNCE_SET	0x43	// Args: key, window.  Used straight away and stored in EEPROM in the background.
+#define VENDOR_CMD_BOUNCE_RESET	0x44	// Give every key the default window.
+#define VENDOR_CMD_BOOT_TIMES	0x50	// Reply: boot_stats (see boot.h) - the hardware_init() steps in us (2 bytes each), first scan,
+					// configuration and first report in ms (2 bytes each), configurations.
+#define VENDOR_CMD_RAM		0x51	// Args: repaint (1 to measure the stack from now on).  Reply: stack_stats_t (see stack.h) - the
+					// SRAM size, .data, .bss and .noinit sizes, stack peak, current depth and headroom (2 bytes each).
+#define VENDOR_CMD_SCAN_STATS	0x52	// Reply: the governor (see governor.h) - scan rate (1 byte), entries to each of the
+					// NUM_SCAN_RATES rates and wakeups (2 bytes each), slow clock (1 byte) - then the scanner (see
+					// keyscan.h) - row settle cycles and recovery faults (2 bytes each) - then KEYSCAN_SETTLE_CYCLES.
+#define VENDOR_CMD_LEDS_EFFECTS	0x60	// Args: set, effects (bit n turns on effect n, see leds.h) - if set is 1, the reactive
+					// backlight effects turned on, saved in the settings.  Reply: the effects turned on.
+#define VENDOR_CMD_REPEAT	0x70	// Args: class, set, delay (2 bytes), interval, shortest interval, acceleration (ms) - if set is
+					// 1, the auto-repeat profile of a class (see repeat.h), saved in the settings.  Reply: the profile.
+#define VENDOR_CMD_MOUSE	0x80	// Args: set, curve, start, top speed, acceleration (2 bytes each) - if set is 1, the mouse key
+					// curve (see mousekey.h), saved in the settings.  Reply: the curve.
+
+// Most data bytes a command can carry after a 4 byte command/argument header.
+#define VENDOR_DATA_MAX		(VENDOR_REPORT_SIZE - 4)
+#if (VENDOR_DATA_MAX > MACROSTORE_PIECE_MAX)
+#error "A MACROS_DATA piece must fit in MACROSTORE_PIECE_MAX."
+#endif
+
+// Reply status codes:
+#define VENDOR_STATUS_OK	REMAP_OK
+#define VENDOR_STATUS_UNKNOWN	1	// Unknown command.
+#define VENDOR_STATUS_BAD_ARG	REMAP_BAD_ARG
+#define VENDOR_STATUS_FULL	REMAP_FULL
+#define VENDOR_STATUS_BAD_CRC	MACROSTORE_BAD_CRC
+#define VENDOR_STATUS_BUSY	REMAP_BUSY
+#if (MACROSTORE_BUSY != REMAP_BUSY)
+#error "The busy status codes of remap.h and macrostore.h must match."
+#endif
+
+// Declarations:
+void vendor_set_report(const uint8_t *report);
+void vendor_get_report(uint8_t *report);
+
+#endif
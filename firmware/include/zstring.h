@@ -0,0 +1,24 @@
+#ifndef _ZSTRING_H_
+#define _ZSTRING_H_
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>	// Needed for reading the compressed text from flash.
+#include "keymap.h"
+
+// Compressed macro text.  The text of the macros in the keymap description is compressed by tools/kmc.py (using tools/macrozip.py)
+// against a dictionary of substrings that repeat across all of it.  A macro action M_ZSTRING, t types piece of text t.  The text is
+// decoded from flash one character at a time, so playback needs only a zstring_t however long the text.
+
+// Decoder state.
+typedef struct
+{
+	const uint8_t *next;	// Next code of the compressed string.
+	const uint8_t *entry;	// Next character of the dictionary entry being expanded.
+	uint8_t remaining;	// Characters left in that entry.
+} zstring_t;
+
+// Declarations:
+void zstring_open(zstring_t *zstring, uint8_t index);
+char zstring_next(zstring_t *zstring);
+
+#endif
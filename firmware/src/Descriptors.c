@@ -80,24 +80,58 @@ const USB_Descriptor_HIDReport_Datatype_t PROGMEM MediaControllerReport[] =
 	HID_RI_USAGE_PAGE(8, 0x0C),		// Consumer Page
 	HID_RI_USAGE(8, 0x01),			// Consumer Controls
 	HID_RI_COLLECTION(8, 0x01),		// Application
-		HID_RI_USAGE(8, 0xB0),		// Play
-		HID_RI_USAGE(8, 0xB1),		// Pause
-		HID_RI_USAGE(8, 0xB3),		// Fast Forward
-		HID_RI_USAGE(8, 0xB4),		// Rewind
-		HID_RI_USAGE(8, 0xB5),		// Next Track
-		HID_RI_USAGE(8, 0xB6),		// Previous Track
-		HID_RI_USAGE(8, 0xB7),		// Stop
-		HID_RI_USAGE(8, 0xCD),		// Play/Pause (toggle)
-		HID_RI_USAGE(8, 0xE2),		// Mute
-		HID_RI_USAGE(8, 0xE9),		// Volume Up
-		HID_RI_USAGE(8, 0xEA),		// Volume Down
-		HID_RI_REPORT_SIZE(8, 0x01),
-		HID_RI_REPORT_COUNT(8, 0x0B),
-		HID_RI_LOGICAL_MINIMUM(8, 0),
-		HID_RI_LOGICAL_MAXIMUM(8, 1),
-		HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_RELATIVE),
-		HID_RI_REPORT_COUNT(8, 0x05),
-		HID_RI_INPUT(8, HID_IOF_CONSTANT),
+		HID_RI_USAGE_MINIMUM(8, 0x00),	// Unassigned (no control)
+		HID_RI_USAGE_MAXIMUM(16, 0x0FFF),	// Any consumer control, as given by the keymap
+		HID_RI_LOGICAL_MINIMUM(8, 0x00),
+		HID_RI_LOGICAL_MAXIMUM(16, 0x0FFF),
+		HID_RI_REPORT_SIZE(8, 0x10),
+		HID_RI_REPORT_COUNT(8, MAX_CONSUMER_KEYS),
+		HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_ARRAY | HID_IOF_ABSOLUTE),
+	HID_RI_END_COLLECTION(0),
+};
+
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM VendorReport[] =
+{
+	HID_RI_USAGE_PAGE(16, 0xFF00),		// Vendor Defined
+	HID_RI_USAGE(8, 0x01),			// Vendor Usage 1
+	HID_RI_COLLECTION(8, 0x01),		// Application
+		HID_RI_USAGE(8, 0x02),		// Vendor Usage 2 (command/reply)
+		HID_RI_LOGICAL_MINIMUM(8, 0x00),
+		HID_RI_LOGICAL_MAXIMUM(16, 0x00FF),
+		HID_RI_REPORT_SIZE(8, 0x08),
+		HID_RI_REPORT_COUNT(8, VENDOR_REPORT_SIZE),
+		HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+	HID_RI_END_COLLECTION(0),
+};
+
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM MouseReport[] =
+{
+	HID_RI_USAGE_PAGE(8, 0x01),		// Generic Desktop
+	HID_RI_USAGE(8, 0x02),			// Mouse
+	HID_RI_COLLECTION(8, 0x01),		// Application
+		HID_RI_USAGE(8, 0x01),		// Pointer
+		HID_RI_COLLECTION(8, 0x00),	// Physical
+			HID_RI_USAGE_PAGE(8, 0x09),	// Button
+			HID_RI_USAGE_MINIMUM(8, 0x01),	// Button 1
+			HID_RI_USAGE_MAXIMUM(8, 0x03),	// Button 3
+			HID_RI_LOGICAL_MINIMUM(8, 0x00),
+			HID_RI_LOGICAL_MAXIMUM(8, 0x01),
+			HID_RI_REPORT_COUNT(8, 0x03),
+			HID_RI_REPORT_SIZE(8, 0x01),
+			HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+			HID_RI_REPORT_COUNT(8, 0x01),
+			HID_RI_REPORT_SIZE(8, 0x05),
+			HID_RI_INPUT(8, HID_IOF_CONSTANT),
+			HID_RI_USAGE_PAGE(8, 0x01),	// Generic Desktop
+			HID_RI_USAGE(8, 0x30),		// X
+			HID_RI_USAGE(8, 0x31),		// Y
+			HID_RI_USAGE(8, 0x38),		// Wheel
+			HID_RI_LOGICAL_MINIMUM(8, -127),
+			HID_RI_LOGICAL_MAXIMUM(8, 127),
+			HID_RI_REPORT_COUNT(8, 0x03),
+			HID_RI_REPORT_SIZE(8, 0x08),
+			HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_RELATIVE),
+		HID_RI_END_COLLECTION(0),
 	HID_RI_END_COLLECTION(0),
 };
 
@@ -138,7 +172,7 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.Header                 = {.Size = sizeof(USB_Descriptor_Configuration_Header_t), .Type = DTYPE_Configuration},
 
 			.TotalConfigurationSize = sizeof(USB_Descriptor_Configuration_t),
-			.TotalInterfaces        = 2,
+			.TotalInterfaces        = 4,
 
 			.ConfigurationNumber    = 1,
 			.ConfigurationStrIndex  = NO_DESCRIPTOR,
@@ -230,6 +264,80 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
 			.EndpointSize           = HID_EPSIZE,
 			.PollingIntervalMS      = 0x05
+		},
+
+	.HID3_VendorInterface =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
+
+			.InterfaceNumber        = INTERFACE_ID_Vendor,
+			.AlternateSetting       = 0x00,
+
+			.TotalEndpoints         = 1,
+
+			.Class                  = HID_CSCP_HIDClass,
+			.SubClass               = HID_CSCP_NonBootSubclass,
+			.Protocol               = HID_CSCP_NonBootProtocol,
+
+			.InterfaceStrIndex      = NO_DESCRIPTOR
+		},
+
+	.HID3_VendorHID =
+		{
+			.Header                 = {.Size = sizeof(USB_HID_Descriptor_HID_t), .Type = HID_DTYPE_HID},
+
+			.HIDSpec                = VERSION_BCD(1,1,1),
+			.CountryCode            = 0x00,
+			.TotalReportDescriptors = 1,
+			.HIDReportType          = HID_DTYPE_Report,
+			.HIDReportLength        = sizeof(VendorReport)
+		},
+
+	.HID3_ReportINEndpoint =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+
+			.EndpointAddress        = VENDOR_IN_EPADDR,
+			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+			.EndpointSize           = HID_EPSIZE,
+			.PollingIntervalMS      = 0xFF
+		},
+
+	.HID4_MouseInterface =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
+
+			.InterfaceNumber        = INTERFACE_ID_Mouse,
+			.AlternateSetting       = 0x00,
+
+			.TotalEndpoints         = 1,
+
+			.Class                  = HID_CSCP_HIDClass,
+			.SubClass               = HID_CSCP_NonBootSubclass,
+			.Protocol               = HID_CSCP_NonBootProtocol,
+
+			.InterfaceStrIndex      = NO_DESCRIPTOR
+		},
+
+	.HID4_MouseHID =
+		{
+			.Header                 = {.Size = sizeof(USB_HID_Descriptor_HID_t), .Type = HID_DTYPE_HID},
+
+			.HIDSpec                = VERSION_BCD(1,1,1),
+			.CountryCode            = 0x00,
+			.TotalReportDescriptors = 1,
+			.HIDReportType          = HID_DTYPE_Report,
+			.HIDReportLength        = sizeof(MouseReport)
+		},
+
+	.HID4_ReportINEndpoint =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+
+			.EndpointAddress        = MOUSE_IN_EPADDR,
+			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+			.EndpointSize           = HID_EPSIZE,
+			.PollingIntervalMS      = 0x01
 		}
 };
 
@@ -299,6 +407,14 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
 					Address = &ConfigurationDescriptor.HID2_MediaControllerHID;
 					Size    = sizeof(USB_HID_Descriptor_HID_t);
 					break;
+				case (INTERFACE_ID_Vendor):
+					Address = &ConfigurationDescriptor.HID3_VendorHID;
+					Size    = sizeof(USB_HID_Descriptor_HID_t);
+					break;
+				case (INTERFACE_ID_Mouse):
+					Address = &ConfigurationDescriptor.HID4_MouseHID;
+					Size    = sizeof(USB_HID_Descriptor_HID_t);
+					break;
 			}
 			break;
 		case HID_DTYPE_Report:
@@ -312,6 +428,14 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
 					Address = &MediaControllerReport;
 					Size    = sizeof(MediaControllerReport);
 					break;
+				case (INTERFACE_ID_Vendor):
+					Address = &VendorReport;
+					Size    = sizeof(VendorReport);
+					break;
+				case (INTERFACE_ID_Mouse):
+					Address = &MouseReport;
+					Size    = sizeof(MouseReport);
+					break;
 			}
 
 			break;
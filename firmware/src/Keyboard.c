@@ -51,10 +51,6 @@ static uint16_t IdleCount = 500;
 // HID class request, thus its value must be preserved.
 static uint16_t IdleMSRemaining = 0;
 
-// Declaration of a keyscan_report_t structure that will be used to pass current keypresses to the keyboard reports and the media
-// controller reports. 
-static keyscan_report_t keyscan_report;
-
 // Configures the board hardware and chip peripherals.
 // Use case is specifically an ATmega32U4 (ARCH_AVR8).
 void SetupHIDHardware(void)
@@ -98,9 +94,16 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 	ConfigSuccess &= Endpoint_ConfigureEndpoint(KEYBOARD_IN_EPADDR, EP_TYPE_INTERRUPT, HID_EPSIZE, 1);
 	ConfigSuccess &= Endpoint_ConfigureEndpoint(KEYBOARD_OUT_EPADDR, EP_TYPE_INTERRUPT, HID_EPSIZE, 1);
 	ConfigSuccess &= Endpoint_ConfigureEndpoint(MEDIACONTROLLER_IN_EPADDR, EP_TYPE_INTERRUPT, HID_EPSIZE, 1);
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(VENDOR_IN_EPADDR, EP_TYPE_INTERRUPT, HID_EPSIZE, 1);
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(MOUSE_IN_EPADDR, EP_TYPE_INTERRUPT, HID_EPSIZE, 1);
 
 	// Turn on Start-of-Frame events for tracking HID report period expiry.
 	USB_Device_EnableSOFEvents();
+
+	// The keys have been scanned all along, so the first report the host polls for carries the keys already held.
+	keyscan_report.keys_changed = true;
+	keyscan_report.consumer_changed = true;
+	boot_configured();
 }
 
 // Event handler for the USB_ControlRequest event. This is used to catch and process control requests sent to the device
@@ -113,8 +116,18 @@ void EVENT_USB_Device_ControlRequest(void)
 		case HID_REQ_GetReport:
 			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
 			{
-				// Determine if it is the keyboard or media controller data that is being requested.
-				if (!(USB_ControlRequest.wIndex))
+				// Determine if it is the keyboard, media controller or vendor data that is being requested.
+				if (USB_ControlRequest.wIndex == INTERFACE_ID_Vendor)
+				{
+					// Write the reply to the last vendor command to the control endpoint.
+					uint8_t VendorReportData[VENDOR_REPORT_SIZE];
+					vendor_get_report(VendorReportData);
+					Endpoint_ClearSETUP();
+					Endpoint_Write_Control_Stream_LE(VendorReportData, sizeof(VendorReportData));
+					Endpoint_ClearOUT();
+					break;
+				}
+				else if (!(USB_ControlRequest.wIndex))
 				{
 
 					// Create the next keyboard report for transmission to the host.
@@ -123,6 +136,14 @@ void EVENT_USB_Device_ControlRequest(void)
 					// Write the report data to the control endpoint.
 					Endpoint_Write_Control_Stream_LE(&KeyboardReportData, sizeof(KeyboardReportData));
 				}
+				else if (USB_ControlRequest.wIndex == INTERFACE_ID_Mouse)
+				{
+					// Create the next mouse report (taking any motion) for transmission to the host.
+					USB_MouseKeysReport_Data_t MouseReportData;
+					CreateMouseReport(&MouseReportData);
+					// Write the report data to the control endpoint.
+					Endpoint_Write_Control_Stream_LE(&MouseReportData, sizeof(MouseReportData));
+				}
 				else
 				{
 					// Create the next media controller report for transmission to the host.
@@ -143,6 +164,18 @@ void EVENT_USB_Device_ControlRequest(void)
 			{
 				Endpoint_ClearSETUP();
 
+				// A vendor command from the host.
+				if (USB_ControlRequest.wIndex == INTERFACE_ID_Vendor)
+				{
+					uint8_t VendorReportData[VENDOR_REPORT_SIZE];
+					Endpoint_Read_Control_Stream_LE(VendorReportData, sizeof(VendorReportData));
+					Endpoint_ClearStatusStage();
+
+					// Carry out the command.
+					vendor_set_report(VendorReportData);
+					break;
+				}
+
 				// Wait until the LED report has been sent by the host.
 				while (!(Endpoint_IsOUTReceived()))
 				{
@@ -216,55 +249,34 @@ void EVENT_USB_Device_StartOfFrame(void)
 {
 	// One millisecond has elapsed, decrement the idle time remaining counter if it has not already elapsed.
 	if (IdleMSRemaining) IdleMSRemaining--;
+
+	// Macros are played at most one report per frame.
+	macroplay_frame();
 }
 
 // Fills the given HID report data structure with the next keyboard HID input report to send to the host.
 // ReportData: Pointer to a HID report data structure to be filled.
-// Report data derived from keyscan report created by the create_keyscan_report() function in keyscan.c.
+// Report data is the keyscan report kept up to date by handle_key() in keyscan.c, unless a macro is typing.
 void CreateKeyboardReport(USB_KeyboardReport_Data_t* const ReportData)
 {
-	// Clear the report contents.
-	memset(ReportData, 0, sizeof(USB_KeyboardReport_Data_t));
+	PROFILE_PROBE(PROBE_KEYBOARD_CREATE);
 
-	// Update the modifier byte from the last keyscan report.
-	ReportData->Modifier = keyscan_report.modifier;
+	ReportData->Reserved = 0;
+
+	// Whilst a macro is typing, the report is the macro's keys only.
+	if(macroplay_fill_report(&ReportData->Modifier, ReportData->KeyCode)) return;
 
-	// Update the keys from the last keyscan report.
-	for(uint8_t i = 0; keyscan_report.keys[i] != 0x00; i++)  ReportData->KeyCode[i] = keyscan_report.keys[i];
+	// Copy the modifier byte and the key slots (empty slots are zero) from the keyscan report.
+	ReportData->Modifier = keyscan_report.modifier;
+	memcpy(ReportData->KeyCode, keyscan_report.keys, MAX_KEYS);
 }
 
 // Fills the given HID report data structure with the next media controller HID input report to send to the host.
 // MediaReportData:  Pointer to a HID report data structure to be filled.
 void CreateMediaControllerReport(USB_MediaControllerReport_Data_t* const MediaReportData)
 {
-	// Clear the report contents.
-	memset(MediaReportData, 0, sizeof(USB_MediaControllerReport_Data_t));
-
-	// Update the Media Control report flags from the latest keyscan report.
-	MediaReportData->Play		= (keyscan_report.media_keys & (1 << MK_PLAY)		? true : false);
-	MediaReportData->Pause		= (keyscan_report.media_keys & (1 << MK_PAUSE)		? true : false);
-	MediaReportData->FForward	= (keyscan_report.media_keys & (1 << MK_FF)		? true : false);
-	MediaReportData->Rewind		= (keyscan_report.media_keys & (1 << MK_RW)		? true : false);
-	MediaReportData->NextTrack	= (keyscan_report.media_keys & (1 << MK_NEXT)		? true : false);
-	MediaReportData->PreviousTrack	= (keyscan_report.media_keys & (1 << MK_PREVIOUS)	? true : false);
-	MediaReportData->Stop		= (keyscan_report.media_keys & (1 << MK_STOP)		? true : false);
-	MediaReportData->PlayPause	= (keyscan_report.media_keys & (1 << MK_TOGGLE)		? true : false);
-	MediaReportData->Mute		= (keyscan_report.media_keys & (1 << MK_MUTE)		? true : false);
-	MediaReportData->VolumeUp	= (keyscan_report.media_keys & (1 << MK_VOL_UP)		? true : false);
-	MediaReportData->VolumeDown	= (keyscan_report.media_keys & (1 << MK_VOL_DOWN)	? true : false);
-}
-
-// Similar to CreateKeyboardReport() function but creates a report for a single specific keypress.
-void CreateMacroKeyReport(USB_KeyboardReport_Data_t* const ReportData, uint8_t keys[MAX_KEYS], uint8_t modifier)
-{
-	// Clear the report contents.
-	memset(ReportData, 0, sizeof(USB_KeyboardReport_Data_t));
-
-	// Apply left shift key if desired character is upper-case.
-	ReportData->Modifier = modifier;
-
-	// Apply the character key code.
-	for(uint8_t k = 0; k < MAX_KEYS; k++) ReportData->KeyCode[k] = keys[k];
+	// Copy the consumer usage slots (empty slots are zero) from the keyscan report.  Both are little-endian.
+	memcpy(MediaReportData->Usage, keyscan_report.consumer_keys, sizeof(MediaReportData->Usage));
 }
 
 // Set or clear the smd LED on the bottom of the board used to indicate the status of Num Lock.
@@ -278,19 +290,26 @@ void numlock_led(bool on)
 // LEDReport: LED status report from the host.
 void ProcessLEDReport(const uint8_t LEDReport)
 {
+	static uint8_t PrevLEDReport = 0;
+	uint8_t LocksChanged = ((LEDReport ^ PrevLEDReport) & (HID_KEYBOARD_LED_NUMLOCK | HID_KEYBOARD_LED_CAPSLOCK));
+
 	if (LEDReport & HID_KEYBOARD_LED_NUMLOCK)	numlock_led(true);
 	else 						numlock_led(false);
+
+	// Echo Num Lock or Caps Lock going on or off on the backlight.
+	if (LocksChanged) leds_lock_echo(LEDReport & LocksChanged);
+	PrevLEDReport = LEDReport;
 }
 
 // Sends the next keyboard HID report to the host, via the keyboard data endpoint.
 void SendNextKeyboardReport(void)
 {
-	static USB_KeyboardReport_Data_t PrevKeyboardReportData;
-	USB_KeyboardReport_Data_t        KeyboardReportData;
-	bool                             SendReport = false;
+	PROFILE_PROBE(PROBE_KEYBOARD_SEND);
 
-	// Create the next keyboard report for transmission to the host.
-	CreateKeyboardReport(&KeyboardReportData);
+	static bool			PrevFromMacro = false;
+	USB_KeyboardReport_Data_t	KeyboardReportData;
+	bool				FromMacro = macroplay_typing();
+	bool				SendReport = false;
 
 	// Check if the idle period is set and has elapsed.
 	if (IdleCount && (!(IdleMSRemaining)))
@@ -303,8 +322,11 @@ void SendNextKeyboardReport(void)
 	}
 	else
 	{
-		// Check to see if the report data has changed - if so a report MUST be sent.
-		SendReport = (memcmp(&PrevKeyboardReportData, &KeyboardReportData, sizeof(USB_KeyboardReport_Data_t)) != 0);
+		// Check to see if the report data has changed (or a macro has taken or handed back the report) - if so a report MUST be
+		// sent.
+		if(FromMacro != PrevFromMacro)	SendReport = true;
+		else if(FromMacro)		SendReport = macroplay_report_pending();
+		else				SendReport = keyscan_report.keys_changed;
 	}
 
 	// Select the Keyboard Report Endpoint.
@@ -313,31 +335,39 @@ void SendNextKeyboardReport(void)
 	// Check if Keyboard Endpoint Ready for Read/Write and if we should send a new report.
 	if (Endpoint_IsReadWriteAllowed() && SendReport)
 	{
-		// Save the current report data for later comparison to check for changes.
-		PrevKeyboardReportData = KeyboardReportData;
+		// Create the next keyboard report for transmission to the host.
+		CreateKeyboardReport(&KeyboardReportData);
 
 		// Write Keyboard Report Data.
 		Endpoint_Write_Stream_LE(&KeyboardReportData, sizeof(KeyboardReportData), NULL);
 
 		// Finalize the stream transfer to send the last packet.
 		Endpoint_ClearIN();
+
+		// The host now has the current report.
+		boot_report_sent();
+		PrevFromMacro = FromMacro;
+		if(!FromMacro) keyscan_report.keys_changed = false;
+		SendReport = false;
 	}
 
-	// Dirty delay to prevent button bounce registering as a double-press.
-	_delay_ms(DEBOUNCE_MS);
+	// Once the host has the current report the macro player or the event pipeline (whichever the report came from) can move on.
+	if(!SendReport)
+	{
+		if(FromMacro)	macroplay_report_sent();
+		else		events_report_sent();
+	}
 }
 
 // Sends the next media controller HID report to the host, via the keyboard data endpoint.
 // This function is very similar to the keyboard equivalent but was created for media controller reports.
 void SendNextMediaControllerReport(void)
 {
-	static USB_MediaControllerReport_Data_t	PrevMediaControllerReportData;
+	PROFILE_PROBE(PROBE_MEDIA_SEND);
+
 	USB_MediaControllerReport_Data_t	MediaControllerReportData;
 	bool					SendReport = false;
 
-	// Create the next keyboard report for transmission to the host.
-	CreateMediaControllerReport(&MediaControllerReportData);
-
 	// Check if the idle period is set and has elapsed.
 	if (IdleCount && (!(IdleMSRemaining)))
 	{
@@ -350,7 +380,7 @@ void SendNextMediaControllerReport(void)
 	else
 	{
 		// Check to see if the report data has changed - if so a report MUST be sent.
-		SendReport = (memcmp(&PrevMediaControllerReportData, &MediaControllerReportData, sizeof(USB_MediaControllerReport_Data_t)) != 0);
+		SendReport = keyscan_report.consumer_changed;
 	}
 
 	// Select the Keyboard Report Endpoint.
@@ -359,8 +389,9 @@ void SendNextMediaControllerReport(void)
 	// Check if Keyboard Endpoint Ready for Read/Write and if we should send a new report.
 	if (Endpoint_IsReadWriteAllowed() && SendReport)
 	{
-		// Save the current report data for later comparison to check for changes.
-		PrevMediaControllerReportData = MediaControllerReportData;
+		// Create the next media controller report for transmission to the host.
+		CreateMediaControllerReport(&MediaControllerReportData);
+		keyscan_report.consumer_changed = false;
 
 		// Write Keyboard Report Data */
 		Endpoint_Write_Stream_LE(&MediaControllerReportData, sizeof(MediaControllerReportData), NULL);
@@ -370,9 +401,41 @@ void SendNextMediaControllerReport(void)
 	}
 }
 
+// Fills the given HID report data structure with the mouse buttons held and the motion since the last report, from the mouse keys.
+// Returns true if there was motion or the buttons have changed.
+bool CreateMouseReport(USB_MouseKeysReport_Data_t* const MouseReportData)
+{
+	return(mousekey_take(&MouseReportData->Button, &MouseReportData->X, &MouseReportData->Y, &MouseReportData->Wheel));
+}
+
+// Sends the next mouse HID report to the host, via the mouse data endpoint.  Unlike the keyboard and media controller reports there
+// is no idle report - a report is only sent whilst the pointer or wheel is moving, or when a button goes down or up.
+void SendNextMouseReport(void)
+{
+	PROFILE_PROBE(PROBE_MOUSE_SEND);
+
+	USB_MouseKeysReport_Data_t	MouseReportData;
+
+	// Select the Mouse Report Endpoint.
+	Endpoint_SelectEndpoint(MOUSE_IN_EPADDR);
+
+	// Check if Mouse Endpoint Ready for Read/Write, and if there is anything to send.  The motion is only taken once the
+	// endpoint is free, so it carries on adding up whilst the host has yet to poll for the last report.
+	if (Endpoint_IsReadWriteAllowed() && CreateMouseReport(&MouseReportData))
+	{
+		// Write Mouse Report Data.
+		Endpoint_Write_Stream_LE(&MouseReportData, sizeof(MouseReportData), NULL);
+
+		// Finalize the stream transfer to send the last packet.
+		Endpoint_ClearIN();
+	}
+}
+
 // Reads the next LED status report from the host from the LED data endpoint, if one has been sent.
 void ReceiveNextKeyboardReport(void)
 {
+	PROFILE_PROBE(PROBE_LEDS_RECEIVE);
+
 	// Select the Keyboard LED Report Endpoint.
 	Endpoint_SelectEndpoint(KEYBOARD_OUT_EPADDR);
 
@@ -394,164 +457,29 @@ void ReceiveNextKeyboardReport(void)
 	}
 }
 
-void SendMacroReports()
+// Function to manage HID report generation and transmission to the host, when in report mode.
+void HID_Task(void)
 {
-	// Read in the address of a macro that corresponds to an actuated macro keyswitch.
-	const macro_t *macro = scan_macro_keys();
+	PROFILE_PROBE(PROBE_HID_TASK);
 
-	// m_value is used to increment for each macro action in the macro array.
-	uint8_t m_count = 0;
+	// Let the key event pipeline decide any tap-hold keys whose tapping term has passed.
+	events_task();
 
-	// If the value returned by scan_macro_keys is not null.
-	if (macro)
+	// Only scan when the scan governor says a scan is due.  The matrix is scanned whether or not the host has configured the
+	// device yet, so that the report is up to date for its first poll.
+	if(governor_scan_due())
 	{
-		// Loop for every valid "macro action".  Type macro_t represents a single such action and "macro" is actually the
-		// address of the first macro_t elements in an array.  This while loop will run until a null value is read which
-		// indicates the last element in the macro array.
-		uint8_t current_macro_action = pgm_read_byte(&macro->m_action + (m_count * sizeof(macro_t)));
-		while(current_macro_action)
-		{
-			// The m_action element of a macro_t struct identifies the succedding array (m_array) as either a string to
-			// be typed sequentially, a combination of keys to be pressed simultaneously, a media keypress or a delay.
-
-			switch(current_macro_action)
-			{
-				// If the macro action type is a string.
-				case M_STRING: ;
-
-					// Loop for each character in the macro array.
-					uint8_t c = 0;
-					while((pgm_read_byte(&macro->m_array[c] + (m_count * sizeof(macro_t)))) && (c < MAX_MACRO_CHARS))
-					{
-						type_key(pgm_read_byte(&macro->m_array[c++] + (m_count * sizeof(macro_t))));
-						USB_USBTask();	// Keep the USB device alive (in case of long strings).
-					}
-
-					break;
-	
-				// If the macro action type is a combination of keys.
-				case M_KEYS: ;
-
-					// Initialise an array of keys and a byte that represents the state of all modifiers.
-					uint8_t macro_keys[MAX_KEYS] = {0};
-					uint8_t macro_modifiers = 0;
-
-					// Loop for each key identified in the macro array.
-					uint8_t k = 0;
-					while((pgm_read_byte(&macro->m_array[k] + (m_count * sizeof(macro_t)))) && (k < MAX_MACRO_CHARS))
-					{
-						uint8_t current_key = (pgm_read_byte(&macro->m_array[k++] + (m_count * sizeof(macro_t))));
-
-						// Regular keys scan values range from 0x00 to 0x65.
-						if(current_key <= HID_KEYBOARD_SC_APPLICATION)
-						{
-							// Skip array elements that already have a keyscan value written.
-							uint8_t j = 0;
-							while((macro_keys[j]) && (j < MAX_KEYS)) j++;
-					
-							// Only register the key if the max simultaneous keys is not reached.
-							if(j < MAX_KEYS) macro_keys[j] = current_key;
-						}
-
-						// Modifier keys scan values start at 0xE0 (after  last keyboard modifier key scan).
-						else if(current_key <= HID_KEYBOARD_SC_RIGHT_GUI)
-						{
-							// Convert the media key to a value from 0 to 7.
-							current_key -= HID_KEYBOARD_SC_LEFT_CONTROL;
-							// Shift a bit to the corresponding bit within the modifier integer.
-							macro_modifiers |= (1 << current_key);
-						}
-					}
-
-					// We now know the combination of keys and modifiers, so send the report.
-					SendNextMacroKeyReport(macro_keys, macro_modifiers);
-
-					// Dirty delay to prevent button bounce registering as a double-press.
-					_delay_ms(DEBOUNCE_MS);
-
-					// Send a "no-key" (i.e. release the key/s).
-					SendNextMacroKeyReport(0x00, 0x00);
-
-					break;
-
-				// If the macro action type is a delay/pause.
-				case M_WAIT: ;
-
-					// Loop through each element of the macro array.
-					uint8_t d = 0;
-					while((pgm_read_byte(&macro->m_array[d] + (m_count * sizeof(macro_t)))) && (d < MAX_MACRO_CHARS))
-					{
-						// Each element of the array represents a number of seconds to pause.
-						for(uint8_t seconds = (pgm_read_byte(&macro->m_array[d++] + (m_count * sizeof(macro_t))));seconds > 0; seconds--)
-						{
-							// Each second-long delay is broken into 4 quarter-seconds.
-							for(uint8_t quarters = 0; quarters < 4; quarters++)
-							{
-								_delay_ms(250);	// Quarter-second delay.
-								USB_USBTask();	// Keep the USB device alive.
-							}
-						}
-					}
-
-					break;
-			}
-
-			// Increment the macro action counter.
-			m_count++;
-
-			// Update the current macro to the next macro_t in memory.
-			current_macro_action = pgm_read_byte(&macro->m_action + (m_count * sizeof(macro_t)));
-		}
-
-		// Wait until the key is released (if held) while keeping the USB device alive.
-		while(scan_macro_keys()) USB_USBTask();
-		// Send a "no-key" (i.e. release the key/s).
-		SendNextMacroKeyReport(0x00, 0x00);
+		// Update the keyscan report - will be used for creating both the keyboard and media controller reports.
+		governor_activity(create_keyscan_report());
+		boot_scanned();
 	}
-}
-
-// Effectivley send a keyboard report but for a single character. 
-void type_key(char key)
-{
-	uint8_t single_key[MAX_KEYS] = {char_to_code(key)};
-	SendNextMacroKeyReport(single_key, (upper_case_check(key) << 1));
-	SendNextMacroKeyReport(0x00, 0x00);	// Send a "no-key" after each actual char (i.e. release the key).
-}
-
-// Similar to the SendNextKeyboardReport() function, but types a single key (with or without modifiers). Intended to be used
-// sequentially to "type" a string of characters - i.e. a macro.
-void SendNextMacroKeyReport(uint8_t keys[MAX_KEYS], uint8_t modifiers)
-{
-	USB_KeyboardReport_Data_t        MacroReportData;
-
-	// Create the next keyboard report for transmission to the host.
-	CreateMacroKeyReport(&MacroReportData, keys, modifiers);
-
-	// Select the Keyboard Report Endpoint.
-	Endpoint_SelectEndpoint(KEYBOARD_IN_EPADDR);
-
-	// Wait until Keyboard Endpoint Ready for Read/Write.
-	while(!Endpoint_IsReadWriteAllowed()) {}
 
-	// Write Keyboard Report Data.
-	Endpoint_Write_Stream_LE(&MacroReportData, sizeof(MacroReportData), NULL);
+	// Play any macros that are running (including any just started by the scan).
+	macroplay_task();
 
-	// Finalize the stream transfer to send the last packet.
-	Endpoint_ClearIN();
-}
-
-// Function to manage HID report generation and transmission to the host, when in report mode.
-void HID_Task(void)
-{
-	// Device must be connected and configured for the task to run.
+	// Device must be connected and configured for reports to be sent.
 	if (USB_DeviceState != DEVICE_STATE_Configured) return;
 
-	// Check for and action any key presses designated as macros.  Only if at least one macro is defined.
-	if(pgm_read_byte(&MACROMAP[0][0][0]))	SendMacroReports();
-
-	// Update the keyscan report - will be used for creating both the keyboard and media controller reports.
-	create_keyscan_report(&keyscan_report);
-
 	// Send the next keypress report to the host.
 	SendNextKeyboardReport();
 
@@ -560,4 +488,7 @@ void HID_Task(void)
 
 	// Send the next media controller keypress report to the host.
 	SendNextMediaControllerReport();
+
+	// Send the next mouse report, if the mouse keys have moved the pointer.
+	SendNextMouseReport();
 }
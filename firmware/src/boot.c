@@ -0,0 +1,65 @@
+// Boot timing - see boot.h.
+
+#include "boot.h"
+
+// Boot timings - see boot.h.
+boot_stats_t boot_stats;
+
+// The system tick at the end of hardware_init() and at the last configuration.
+static uint16_t init_ms;
+static uint16_t configured_at_ms;
+
+// Milestones still to be timed.
+static bool scan_pending = true;
+static bool report_pending = false;
+
+// Start timing hardware_init().  Called first thing.
+void boot_start(void)
+{
+	// Count up to 1023 (the 10-bit TOP is written high bits first).
+	BOOT_TIMER_HIGH = 0x03;
+	BOOT_TIMER_TOP = 0xFF;
+	BOOT_TIMER_TCCRB = BOOT_TIMER_CS;
+}
+
+// A step of hardware_init() is done.  The last one stops the timer.
+void boot_mark(uint8_t mark)
+{
+	uint8_t low = BOOT_TIMER_COUNT;		// Reading the low byte latches the high bits into BOOT_TIMER_HIGH.
+	uint16_t count = (low | ((uint16_t)BOOT_TIMER_HIGH << 8));
+
+	boot_stats.mark_us[mark] = (count * BOOT_TIMER_US);
+
+	if(mark == BOOT_MARK_INIT)
+	{
+		BOOT_TIMER_TCCRB = 0;
+		init_ms = systick_ms();
+	}
+}
+
+// The matrix has been scanned.  Called after every scan, but only the first is timed.
+void boot_scanned(void)
+{
+	if(!scan_pending) return;
+
+	boot_stats.first_scan_ms = (systick_ms() - init_ms);
+	scan_pending = false;
+}
+
+// The host has configured the device.
+void boot_configured(void)
+{
+	configured_at_ms = systick_ms();
+	boot_stats.configured_ms = (configured_at_ms - init_ms);
+	boot_stats.configurations++;
+	report_pending = true;
+}
+
+// A keyboard report has been written for the host.  Only the first after each configuration is timed.
+void boot_report_sent(void)
+{
+	if(!report_pending) return;
+
+	boot_stats.report_ms = (systick_ms() - configured_at_ms);
+	report_pending = false;
+}
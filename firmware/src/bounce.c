@@ -0,0 +1,166 @@
+// Per-key debounce and the bounce profiler - see bounce.h.
+
+#include "bounce.h"
+
+// The debounce window of each key, in system ticks.
+uint8_t bounce_window[MATRIX_KEYS];
+
+// True whilst the profiler is running.
+bool bounce_profiling = false;
+
+// The stored windows.  The number of keys is written last (and must match the matrix), so a save cut short by a reset, or left over
+// from a different keymap, is never loaded.
+static uint16_t EEMEM ee_bounce_magic;
+static uint8_t EEMEM ee_bounce_keys;
+static uint8_t EEMEM ee_bounce_window[MATRIX_KEYS];
+
+// Whilst storing the windows: the next step (save_step == SAVE_DONE when not storing).  Step 0 clears the number of keys, then there
+// is a step for each window, and the last three write the magic and the number of keys - one EEPROM byte per step.  Forgetting the
+// stored windows is step 0 alone.
+#define SAVE_DONE	0xFFFF
+static uint16_t save_step = SAVE_DONE;
+static bool forget = false;
+
+// What the profiler has seen of each key, and the matrix as last sampled.
+static bounce_stats_t stats[MATRIX_KEYS];
+static matrix_row_t raw[MATRIX_ROWS];
+
+// Load the stored windows, or give every key the default one.
+void bounce_init(void)
+{
+	if((eeprom_read_word(&ee_bounce_magic) == BOUNCE_MAGIC) && (eeprom_read_byte(&ee_bounce_keys) == MATRIX_KEYS))
+	{
+		eeprom_read_block(bounce_window, ee_bounce_window, MATRIX_KEYS);
+	}
+	else memset(bounce_window, BOUNCE_DEFAULT_TICKS, MATRIX_KEYS);
+}
+
+// Store the windows in EEPROM, in the background (starting over if already storing, as a window may have changed).
+static void save(void)
+{
+	forget = false;
+	save_step = 0;
+}
+
+// Write the next byte of the stored windows.  Called every pass of the main loop.
+void bounce_task(void)
+{
+	uint8_t *address;
+	uint8_t value;
+
+	if((save_step == SAVE_DONE) || !eeprom_is_ready()) return;
+
+	if(!save_step)
+	{
+		address = &ee_bounce_keys;
+		value = 0;
+	}
+	else if(save_step <= MATRIX_KEYS)
+	{
+		address = &ee_bounce_window[save_step - 1];
+		value = bounce_window[save_step - 1];
+	}
+	else if(save_step == (MATRIX_KEYS + 1))
+	{
+		address = (uint8_t *)&ee_bounce_magic;
+		value = (BOUNCE_MAGIC & 0xFF);
+	}
+	else if(save_step == (MATRIX_KEYS + 2))
+	{
+		address = ((uint8_t *)&ee_bounce_magic) + 1;
+		value = (BOUNCE_MAGIC >> 8);
+	}
+	else
+	{
+		address = &ee_bounce_keys;
+		value = MATRIX_KEYS;
+	}
+	eeprom_update_byte(address, value);
+
+	if((forget && !save_step) || (save_step == (MATRIX_KEYS + 3)))	save_step = SAVE_DONE;
+	else								save_step++;
+}
+
+// Start profiling from the current (debounced) state of the matrix.  The scanner gives every key the longest window whilst it runs.
+void bounce_start(const matrix_row_t *matrix)
+{
+	memset(stats, 0, sizeof(stats));
+	memcpy(raw, matrix, sizeof(raw));
+	bounce_profiling = true;
+}
+
+// Check a sample of the whole matrix for edges and chatter.  Called by the scanner with every sample whilst profiling.
+void bounce_sample(const matrix_row_t *samples, uint16_t now)
+{
+	for(uint8_t r = 0; r < MATRIX_ROWS; r++)
+	{
+		matrix_row_t changed = samples[r] ^ raw[r];
+		raw[r] = samples[r];
+
+		for(uint8_t key = r * MATRIX_COLS; changed; key++, changed >>= 1)
+		{
+			if(!(changed & 1)) continue;
+
+			bounce_stats_t *s = &stats[key];
+			uint16_t since = (now - s->edge_tick);
+
+			if(s->edges && (since < BOUNCE_MAX_TICKS))
+			{
+				if(s->chatter < 0xFF) s->chatter++;
+				if(since > s->bounce_ticks) s->bounce_ticks = since;
+			}
+			else
+			{
+				if(s->edges < 0xFFFF) s->edges++;
+				s->edge_tick = now;
+			}
+		}
+	}
+}
+
+// Stop profiling.  If tune is true, every key seen for long enough is given a window just longer than its longest bounce and the
+// windows are stored, otherwise the windows stay as they were.  Returns the number of keys tuned.
+uint8_t bounce_stop(bool tune)
+{
+	uint8_t tuned = 0;
+
+	bounce_profiling = false;
+	if(!tune) return(0);
+
+	for(uint8_t key = 0; key < MATRIX_KEYS; key++)
+	{
+		if(stats[key].edges < BOUNCE_MIN_EDGES) continue;
+
+		uint8_t ticks = (stats[key].bounce_ticks + 1 + BOUNCE_MARGIN_TICKS);
+		bounce_window[key] = ((ticks > BOUNCE_MAX_TICKS) ? BOUNCE_MAX_TICKS : ticks);
+		tuned++;
+	}
+
+	if(tuned) save();
+	return(tuned);
+}
+
+// Copy what the profiler has seen of a key (since it was last started).
+void bounce_read(uint8_t key, bounce_stats_t *key_stats)
+{
+	*key_stats = stats[key];
+}
+
+// Set the window of a key (1 to BOUNCE_MAX_TICKS ticks) and store it.
+uint8_t bounce_set(uint8_t key, uint8_t ticks)
+{
+	if((key >= MATRIX_KEYS) || !ticks || (ticks > BOUNCE_MAX_TICKS) || bounce_profiling) return(BOUNCE_BAD_ARG);
+
+	bounce_window[key] = ticks;
+	save();
+	return(BOUNCE_OK);
+}
+
+// Give every key the default window again, and forget the stored ones.
+void bounce_reset(void)
+{
+	bounce_profiling = false;
+	memset(bounce_window, BOUNCE_DEFAULT_TICKS, MATRIX_KEYS);
+	forget = true;
+	save_step = 0;
+}
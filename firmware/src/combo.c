@@ -0,0 +1,171 @@
+// Combo engine - see combo.h.
+
+#include "combo.h"
+#include "taphold.h"
+
+// For each key, the combos it is part of.  Worked out from COMBOS once by combo_init() so that a press only ever looks at the combos
+// that include that key.
+static combo_mask_t key_combos[MATRIX_KEYS];
+
+// Number of keys in each combo.
+static uint8_t combo_sizes[MAX_COMBOS];
+
+// Presses held back whilst they might still make a combo, when the first of them happened and the combos they could still make.
+static uint8_t held_keys[COMBO_MAX_KEYS];
+static uint16_t held_times[COMBO_MAX_KEYS];
+static uint8_t held_count = 0;
+static combo_mask_t candidates;
+
+// Combos that have fired and not yet been released, and keys whose releases are to be swallowed because they made a combo.
+static combo_mask_t active_combos = 0;
+static matrix_row_t suppressed[MATRIX_ROWS];
+
+// Build the per-key combo index.
+void combo_init(void)
+{
+	uint8_t count = ((num_combos < MAX_COMBOS) ? num_combos : MAX_COMBOS);
+
+	memset(key_combos, 0, sizeof(key_combos));
+	for(uint8_t c = 0; c < count; c++)
+	{
+		uint8_t size = 0;
+		for(; size < COMBO_MAX_KEYS; size++)
+		{
+			uint8_t key = pgm_read_byte(&COMBOS[c].keys[size]);
+			if(key >= MATRIX_KEYS) break;
+			key_combos[key] |= ((combo_mask_t)1 << c);
+		}
+		combo_sizes[c] = size;
+	}
+
+	held_count = 0;
+	active_combos = 0;
+	memset(suppressed, 0, sizeof(suppressed));
+}
+
+// Returns the keycode sent by a combo.
+keycode_t combo_keycode(uint8_t combo)
+{
+	return(pgm_read_word(&COMBOS[combo].keycode));
+}
+
+// Returns a combo that the held back keys make exactly (the lowest numbered if several), or 0xFF if none.
+static uint8_t combo_complete(void)
+{
+	combo_mask_t mask = candidates;
+
+	for(uint8_t c = 0; mask; c++, mask >>= 1)
+	{
+		if((mask & 1) && (combo_sizes[c] == held_count)) return(c);
+	}
+
+	return(0xFF);
+}
+
+// Returns true if the held back keys could still become a larger combo.
+static bool combo_can_grow(void)
+{
+	combo_mask_t mask = candidates;
+
+	for(uint8_t c = 0; mask; c++, mask >>= 1)
+	{
+		if((mask & 1) && (combo_sizes[c] > held_count)) return(true);
+	}
+
+	return(false);
+}
+
+// The held back keys make the given combo - swallow them and send the combo on as its own key.
+static void combo_fire(uint8_t combo)
+{
+	for(uint8_t i = 0; i < held_count; i++)
+		suppressed[held_keys[i] / MATRIX_COLS] |= ((matrix_row_t)1 << (held_keys[i] % MATRIX_COLS));
+
+	active_combos |= ((combo_mask_t)1 << combo);
+	taphold_event(MATRIX_KEYS + combo, true, held_times[0]);
+	held_count = 0;
+}
+
+// Fire the combo the held back keys make, or send them on as ordinary presses.
+static void combo_flush(void)
+{
+	uint8_t combo = combo_complete();
+
+	if(held_count && (combo != 0xFF))
+	{
+		combo_fire(combo);
+		return;
+	}
+
+	for(uint8_t i = 0; i < held_count; i++) taphold_event(held_keys[i], true, held_times[i]);
+	held_count = 0;
+}
+
+// A key went down or up at the given time.
+void combo_event(uint8_t key, bool pressed, uint16_t time)
+{
+	uint8_t r = key / MATRIX_COLS;
+	matrix_row_t bit = ((matrix_row_t)1 << (key % MATRIX_COLS));
+
+	if(!pressed)
+	{
+		// The key made a combo - release the combo (once) and swallow the key.
+		if(suppressed[r] & bit)
+		{
+			suppressed[r] &= ~bit;
+
+			combo_mask_t releasing = (active_combos & key_combos[key]);
+			for(uint8_t c = 0; releasing; c++, releasing >>= 1)
+			{
+				if(releasing & 1)
+				{
+					active_combos &= ~((combo_mask_t)1 << c);
+					taphold_event(MATRIX_KEYS + c, false, time);
+				}
+			}
+			return;
+		}
+
+		// A held back key going up ends the combo attempt (a quick tap of a whole combo still fires it).
+		for(uint8_t i = 0; i < held_count; i++)
+		{
+			if(held_keys[i] == key)
+			{
+				combo_flush();
+				if(suppressed[r] & bit) combo_event(key, false, time);
+				else			taphold_event(key, false, time);
+				return;
+			}
+		}
+
+		// Any other release goes straight through - its press was sent on before any held back key went down.
+		taphold_event(key, false, time);
+		return;
+	}
+
+	// A press that cannot add to the held back keys sends them on, then is dealt with afresh.
+	if(held_count && !(candidates & key_combos[key])) combo_flush();
+
+	// Keys in no combo go straight through.
+	if(!held_count && !key_combos[key])
+	{
+		taphold_event(key, true, time);
+		return;
+	}
+
+	// Hold the key back.
+	if(!held_count) candidates = key_combos[key];
+	else		candidates &= key_combos[key];
+	held_keys[held_count] = key;
+	held_times[held_count] = time;
+	held_count++;
+
+	// Fire straight away once the keys make a combo that no further key could extend.
+	if(!combo_can_grow()) combo_flush();
+}
+
+// Give up on a combo once COMBO_TERM_MS has passed since its first key went down.
+void combo_task(uint16_t now)
+{
+	if(held_count && ((uint16_t)(now - held_times[0]) >= COMBO_TERM_MS)) combo_flush();
+}
@@ -0,0 +1,241 @@
+// Dynamic macros - see dynmacro.h.
+
+#include "dynmacro.h"
+
+// The recording.
+static dynmacro_event_t arena[DYNMACRO_EVENTS];
+static uint8_t count = 0;
+
+// The saved recording.  The count is only written once the events are, so a save cut short by a reset is never loaded.
+static uint16_t EEMEM ee_dynmacro_magic;
+static uint8_t EEMEM ee_dynmacro_count;
+static dynmacro_event_t EEMEM ee_dynmacro[DYNMACRO_EVENTS];
+
+// What the recorder is doing.
+#define DM_IDLE		0
+#define DM_RECORDING	1
+#define DM_PLAYING	2
+#define DM_PLAYING_FAST	3
+static uint8_t state = DM_IDLE;
+
+// When the last event was recorded or played.
+static uint16_t last_ms;
+
+// Whilst recording: the keys recorded as pressed and not yet released.
+static matrix_row_t held[EVENT_ROWS];
+static uint8_t held_count;
+
+// Whilst playing: the presses of the recording (by index) played and not yet released.
+static uint8_t played[(DYNMACRO_EVENTS + 7) / 8];
+
+// Whilst playing: the next event to play.
+static uint8_t play_index;
+
+// Whilst saving: the next step of the save (save_step == SAVE_DONE when not saving).  Step 0 clears the count, then there is a step
+// for each byte of the events, and the last three write the magic and the count - one EEPROM byte per step.
+#define SAVE_DONE	0xFFFF
+static uint16_t save_step = SAVE_DONE;
+
+// Load any saved recording.
+void dynmacro_init(void)
+{
+	count = 0;
+	if(eeprom_read_word(&ee_dynmacro_magic) != DYNMACRO_MAGIC) return;
+
+	uint8_t saved = eeprom_read_byte(&ee_dynmacro_count);
+	if(saved > DYNMACRO_EVENTS) return;
+
+	eeprom_read_block(arena, ee_dynmacro, saved * sizeof(dynmacro_event_t));
+	count = saved;
+}
+
+// Add an event to the recording.
+static void record(keycode_t keycode, uint8_t flags)
+{
+	uint16_t now = systick_ms();
+	uint16_t ticks = ((uint16_t)(now - last_ms) / DYNMACRO_TICK_MS);
+
+	arena[count].keycode = keycode;
+	arena[count].flags = flags;
+	arena[count].ticks = ((ticks > 0xFF) ? 0xFF : ticks);
+	count++;
+	last_ms = now;
+}
+
+// End playback, releasing any keycodes it left held.
+static void stop_playing(void)
+{
+	for(uint8_t i = 0; i < play_index; i++)
+	{
+		if(!(played[i / 8] & (1 << (i % 8)))) continue;
+
+		played[i / 8] &= ~(1 << (i % 8));
+		events_play(arena[i].keycode, false);
+	}
+	state = DM_IDLE;
+}
+
+// Note a played event, so stopping part way can release what it left held.  A release ends the earliest held press of its keycode.
+static void note_played(uint8_t index)
+{
+	if(arena[index].flags & EVENT_PRESSED)
+	{
+		played[index / 8] |= (1 << (index % 8));
+		return;
+	}
+
+	for(uint8_t i = 0; i < index; i++)
+	{
+		if(!(played[i / 8] & (1 << (i % 8))) || (arena[i].keycode != arena[index].keycode)) continue;
+
+		played[i / 8] &= ~(1 << (i % 8));
+		return;
+	}
+}
+
+// End a recording, releasing any keys it left held.
+static void stop_recording(void)
+{
+	for(uint8_t key = 0; held_count && (key < EVENT_KEYS); key++)
+	{
+		matrix_row_t bit = ((matrix_row_t)1 << (key % MATRIX_COLS));
+		if(!(held[key / MATRIX_COLS] & bit)) continue;
+
+		held[key / MATRIX_COLS] &= ~bit;
+		held_count--;
+		record(events_keycode(key), 0);
+	}
+	state = DM_IDLE;
+}
+
+// A dynamic macro key went down.
+void dynmacro_key(keycode_t keycode)
+{
+	switch(keycode)
+	{
+		// Start a new recording (or end the current one).
+		case DM_REC:
+			if(state == DM_RECORDING)
+			{
+				stop_recording();
+				break;
+			}
+			if((state != DM_IDLE) || (save_step != SAVE_DONE)) break;
+			count = 0;
+			held_count = 0;
+			memset(held, 0, sizeof(held));
+			last_ms = systick_ms();
+			state = DM_RECORDING;
+			break;
+
+		case DM_STOP:
+			if(state == DM_RECORDING)	stop_recording();
+			else if(state != DM_IDLE)	stop_playing();
+			break;
+
+		// Play the recording (unless recording or saving it).
+		case DM_PLAY:
+		case DM_FAST:
+			if((state != DM_IDLE) || !count || (save_step != SAVE_DONE)) break;
+			play_index = 0;
+			memset(played, 0, sizeof(played));
+			last_ms = systick_ms();
+			state = ((keycode == DM_PLAY) ? DM_PLAYING : DM_PLAYING_FAST);
+			break;
+
+		// Start writing the recording to EEPROM (in dynmacro_task()).
+		case DM_SAVE:
+			if(state == DM_RECORDING) break;
+			save_step = 0;
+			break;
+	}
+}
+
+// A resolved key event was applied, and its key resolved to keycode.  Recorded if a recording is being made and there is room for it
+// (and for releasing every key that would then be held).
+void dynmacro_record(uint8_t key, uint8_t flags, keycode_t keycode)
+{
+	if(state != DM_RECORDING) return;
+
+	matrix_row_t bit = ((matrix_row_t)1 << (key % MATRIX_COLS));
+
+	if(flags & EVENT_PRESSED)
+	{
+		if((held[key / MATRIX_COLS] & bit) || ((count + held_count + 2) > DYNMACRO_EVENTS))
+		{
+			// The arena is full - end the recording here.
+			if(!(held[key / MATRIX_COLS] & bit)) stop_recording();
+			return;
+		}
+		held[key / MATRIX_COLS] |= bit;
+		held_count++;
+	}
+	else
+	{
+		// Releases of keys pressed before the recording started are left out.
+		if(!(held[key / MATRIX_COLS] & bit)) return;
+		held[key / MATRIX_COLS] &= ~bit;
+		held_count--;
+	}
+
+	record(keycode, flags);
+}
+
+// Play the next event of the recording when it is due, and write the next byte of a save.  Called every pass of the main loop.
+void dynmacro_task(uint16_t now)
+{
+	if((state == DM_PLAYING) || (state == DM_PLAYING_FAST))
+	{
+		dynmacro_event_t *event = &arena[play_index];
+
+		// At the recorded timing, or as soon as the pipeline has nothing left to send.
+		if(state == DM_PLAYING)
+		{
+			if((uint16_t)(now - last_ms) < ((uint16_t)event->ticks * DYNMACRO_TICK_MS)) return;
+		}
+		else if(!events_idle()) return;
+
+		note_played(play_index);
+		events_play(event->keycode, (event->flags & EVENT_PRESSED));
+		last_ms = now;
+		if(++play_index == count) state = DM_IDLE;
+	}
+
+	if((save_step != SAVE_DONE) && eeprom_is_ready())
+	{
+		uint16_t bytes = (count * sizeof(dynmacro_event_t));
+		uint8_t *address;
+		uint8_t value;
+
+		// The count is cleared before the events are overwritten and only written once they (and the magic) are in, so a save cut
+		// short by a reset is never loaded.
+		if(!save_step)
+		{
+			address = &ee_dynmacro_count;
+			value = 0;
+		}
+		else if(save_step <= bytes)
+		{
+			address = ((uint8_t *)ee_dynmacro) + (save_step - 1);
+			value = ((uint8_t *)arena)[save_step - 1];
+		}
+		else if(save_step == (bytes + 1))
+		{
+			address = (uint8_t *)&ee_dynmacro_magic;
+			value = (DYNMACRO_MAGIC & 0xFF);
+		}
+		else if(save_step == (bytes + 2))
+		{
+			address = ((uint8_t *)&ee_dynmacro_magic) + 1;
+			value = (DYNMACRO_MAGIC >> 8);
+		}
+		else
+		{
+			address = &ee_dynmacro_count;
+			value = count;
+		}
+		eeprom_update_byte(address, value);
+
+		if(save_step++ == (bytes + 3)) save_step = SAVE_DONE;
+	}
+}
@@ -0,0 +1,284 @@
+// The key event pipeline - see events.h.
+
+#include "events.h"
+#include "combo.h"
+#include "taphold.h"
+#include "macrostore.h"
+#include "macroplay.h"
+#include "dynmacro.h"
+#include "leds.h"
+#include "repeat.h"
+
+// A resolved key event waiting to be applied.
+typedef struct
+{
+	uint8_t key;
+	uint8_t flags;		// EVENT_PRESSED and the role, or EVENT_PLAYED.
+	keycode_t keycode;	// The keycode of a played event (the key is not used).
+} resolved_event_t;
+
+// Queue of resolved events (circular).
+static resolved_event_t queue[EVENTS_QUEUE_SIZE];
+static uint8_t queue_head = 0;
+static uint8_t queue_count = 0;
+
+// Keys currently registered (i.e. that the host should see as down), and which of those are dual-role keys registered as a tap
+// or a hold.
+static matrix_row_t registered[EVENT_ROWS];
+static matrix_row_t registered_tap[EVENT_ROWS];
+static matrix_row_t registered_hold[EVENT_ROWS];
+
+// Set once the report built from the registered keys has been handed to the host, so the next batch of events can be applied.
+static bool report_sent = true;
+
+// Returns macro n of the compiled-in macros, or 0 if there is no such macro.
+static const macro_t *macro_lookup(uint8_t n)
+{
+	if(n >= MACRO_COUNT) return(0);
+
+	return(&macro_data[pgm_read_word(&macro_offsets[n])]);
+}
+
+// Start with nothing registered on the base layer.
+void events_init(void)
+{
+	layers_init();
+	combo_init();
+	taphold_init();
+	macroplay_init();
+	dynmacro_init();
+	repeat_init();
+}
+
+// A key went down (pressed = true) or up.  Entry point from the scanner.
+void events_key(uint8_t key, bool pressed)
+{
+	combo_event(key, pressed, systick_ms());
+}
+
+// Run any time-based decisions.  Called every pass of the main loop.
+void events_task(void)
+{
+	uint16_t now = systick_ms();
+
+	combo_task(now);
+	taphold_task(now);
+	dynmacro_task(now);
+	repeat_task(now);
+
+	// Apply what is queued as soon as the last report has gone, rather than waiting for the next scan - played and repeated
+	// events arrive between scans, and the governor scans less often once the keys are idle.
+	events_apply();
+}
+
+// Start the macro of a macro keycode (see macroplay.h).
+static void start_macro(keycode_t keycode)
+{
+	if(KC_KIND(keycode) == KC_SMACRO) macroplay_start(macrostore_macro(KC_ARG(keycode)));
+	else if((keycode >= HID_KEYBOARD_SC_MACRO_FIRST) && (keycode <= HID_KEYBOARD_SC_MACRO_LAST))
+		macroplay_start(macro_lookup(keycode - HID_KEYBOARD_SC_MACRO_FIRST));
+}
+
+// Action the layer functions and macros of a keycode that has gone down (other than the dynamic macro keys).
+static void press_keycode(keycode_t keycode)
+{
+	switch(KC_KIND(keycode))
+	{
+		case KC_MO:	layers_on(KC_ARG(keycode));	break;
+		case KC_TG:	layers_toggle(KC_ARG(keycode));	break;
+		case KC_OSL:	layers_oneshot(KC_ARG(keycode));	break;
+
+		// Any other key uses up a one-shot layer and may start a macro.
+		default:
+			layers_oneshot_clear();
+			start_macro(keycode);
+			break;
+	}
+}
+
+// Apply a keycode played back by the dynamic macro recorder.  It is already resolved, so it is pressed and released as it was
+// recorded whatever the layers are now, and it is not tied to a key - so it never clashes with a key being held by hand (the report
+// counts the holds of each usage).  Played keycodes do not auto-repeat.
+static void events_register_played(keycode_t keycode, bool pressed)
+{
+	if(pressed)
+	{
+		leds_key();
+		press_keycode(keycode);
+	}
+	else if(KC_KIND(keycode) == KC_MO) layers_off(KC_ARG(keycode));
+
+	handle_key(keycode, pressed);
+}
+
+// Register or release a key.  A repeat press (from the auto-repeat engine) goes back down as the keycode the key was first pressed
+// as, without resolving it through the layers again or using up a one-shot layer.
+static void events_register(uint8_t key, bool pressed, uint8_t role, bool repeat)
+{
+	uint8_t r = key / MATRIX_COLS;
+	matrix_row_t bit = ((matrix_row_t)1 << (key % MATRIX_COLS));
+	keycode_t keycode;
+
+	if(pressed && repeat)
+	{
+		registered[r] |= bit;
+		if(role == ROLE_TAP)	registered_tap[r] |= bit;
+		if(role == ROLE_HOLD)	registered_hold[r] |= bit;
+		keycode = events_keycode(key);
+
+		// Only keyboard keys, consumer keys and macros repeat (see repeat.h) - a macro key starts its macro again.
+		start_macro(keycode);
+		handle_key(keycode, true);
+	}
+	else if(pressed)
+	{
+		// Let the backlight react to the press.
+		leds_key();
+
+		// Resolve the key through the layers and note how a dual-role key was decided.
+		if(key < MATRIX_KEYS) layers_resolve(key);
+		registered[r] |= bit;
+		if(role == ROLE_TAP)	registered_tap[r] |= bit;
+		if(role == ROLE_HOLD)	registered_hold[r] |= bit;
+		keycode = events_keycode(key);
+
+		// Dynamic macro keys control the recorder, and are the only keys it does not record.
+		if(KC_KIND(keycode) == KC_DYNMACRO)
+		{
+			dynmacro_key(keycode);
+			return;
+		}
+
+		// Action layer functions and macros.
+		press_keycode(keycode);
+
+		// Let the key repeat whilst held, and add it to the report.
+		repeat_pressed(key, keycode, role);
+		handle_key(keycode, true);
+	}
+	else
+	{
+		// Ignore releases of keys that were never registered.
+		if(!(registered[r] & bit)) return;
+
+		// Release from the keycode the key was pressed as, ending a momentary layer.
+		keycode = events_keycode(key);
+		if(KC_KIND(keycode) == KC_MO) layers_off(KC_ARG(keycode));
+		handle_key(keycode, false);
+
+		registered[r] &= ~bit;
+		registered_tap[r] &= ~bit;
+		registered_hold[r] &= ~bit;
+		if(KC_KIND(keycode) == KC_DYNMACRO) return;
+	}
+
+	dynmacro_record(key, (pressed ? EVENT_PRESSED : 0), keycode);
+}
+
+// Apply a queued event.
+static void apply_event(const resolved_event_t *event)
+{
+	if(event->flags & EVENT_PLAYED)	events_register_played(event->keycode, (event->flags & EVENT_PRESSED));
+	else				events_register(event->key, (event->flags & EVENT_PRESSED), (event->flags & EVENT_ROLE),
+						(event->flags & EVENT_REPEAT));
+}
+
+// Queue a resolved event.
+static void queue_event(uint8_t key, uint8_t flags, keycode_t keycode)
+{
+	// If the queue is full (the host has not been taking reports) apply the oldest event now rather than lose it.
+	if(queue_count == EVENTS_QUEUE_SIZE)
+	{
+		apply_event(&queue[queue_head]);
+		queue_head = (queue_head + 1) % EVENTS_QUEUE_SIZE;
+		queue_count--;
+	}
+
+	resolved_event_t *event = &queue[(queue_head + queue_count) % EVENTS_QUEUE_SIZE];
+	event->key = key;
+	event->flags = flags;
+	event->keycode = keycode;
+	queue_count++;
+}
+
+// Queue a resolved event.  Called by the last stage of the pipeline.
+void events_output(uint8_t key, bool pressed, uint8_t role)
+{
+	// A key going up stops its auto-repeat straight away, before anything queued ahead of it is applied.
+	if(!pressed) repeat_released(key);
+	queue_event(key, ((pressed ? EVENT_PRESSED : 0) | role), 0);
+}
+
+// Queue a release or press made by the auto-repeat engine (see repeat.h), which it does not see itself.
+void events_repeat(uint8_t key, bool pressed, uint8_t role)
+{
+	queue_event(key, ((pressed ? EVENT_PRESSED : 0) | EVENT_REPEAT | role), 0);
+}
+
+// Queue a press or release of a keycode played back by the dynamic macro recorder (see dynmacro.h).
+void events_play(keycode_t keycode, bool pressed)
+{
+	queue_event(0, ((pressed ? EVENT_PRESSED : 0) | EVENT_PLAYED), keycode);
+}
+
+// Apply the next batch of queued events to the registered keys, once the last report has been sent.  A batch stops short of
+// releasing a key that it pressed, so that every press is seen by the host in at least one report.
+void events_apply(void)
+{
+	uint8_t batch_keys[EVENTS_QUEUE_SIZE];
+	uint8_t batch_count = 0;
+	bool batch_played = false;	// Played events have no key, so a played release waits for any played press.
+
+	if(!report_sent) return;
+
+	while(queue_count)
+	{
+		resolved_event_t *event = &queue[queue_head];
+
+		if(event->flags & EVENT_PLAYED)
+		{
+			if(!(event->flags & EVENT_PRESSED) && batch_played) break;
+			if(event->flags & EVENT_PRESSED) batch_played = true;
+		}
+		else if(!(event->flags & EVENT_PRESSED))
+		{
+			uint8_t i = 0;
+			while((i < batch_count) && (batch_keys[i] != event->key)) i++;
+			if(i < batch_count) break;
+		}
+		else batch_keys[batch_count++] = event->key;
+
+		apply_event(event);
+		queue_head = (queue_head + 1) % EVENTS_QUEUE_SIZE;
+		queue_count--;
+		report_sent = false;
+	}
+}
+
+// Returns true once every queued event has been applied and reported to the host.
+bool events_idle(void)
+{
+	return(!queue_count && report_sent);
+}
+
+// The keyboard report has been written to the endpoint (or did not need to change).
+void events_report_sent(void)
+{
+	report_sent = true;
+}
+
+// Returns the keycode a registered key is acting as - the tap or hold function of a dual-role key, or the keycode of a combo.
+keycode_t events_keycode(uint8_t key)
+{
+	if(key >= MATRIX_KEYS) return(combo_keycode(key - MATRIX_KEYS));
+
+	keycode_t keycode = layers_keycode(key);
+
+	if(KC_IS_TAP_HOLD(keycode))
+	{
+		if(registered_hold[key / MATRIX_COLS] & ((matrix_row_t)1 << (key % MATRIX_COLS)))	return(KC_HOLD(keycode));
+		else											return(KC_TAP(keycode));
+	}
+
+	return(keycode);
+}
@@ -0,0 +1,96 @@
+#include "governor.h"
+#include "leds.h"
+
+// Each scan rate is defined by an interval in system ticks and the idle time to hold that rate before stepping down.
+// The first entry must be the fastest rate and the last the slowest.  With SYSTICK_HZ at 4000 one tick is 250us.
+const struct scan_rate scan_rates[NUM_SCAN_RATES] =
+{
+	{ .interval_ticks = 1,	.hold_ms = SCAN_FAST_WINDOW_MS},	// Rate 0 - 4kHz, active typing.
+	{ .interval_ticks = 4,	.hold_ms = 5000},			// Rate 1 - 1kHz.
+	{ .interval_ticks = 16,	.hold_ms = 60000},			// Rate 2 - 250Hz.
+	{ .interval_ticks = 40,	.hold_ms = 0},				// Rate 3 - 100Hz, long-term idle.
+};
+
+// Counters - see governor.h.
+governor_stats_t governor_stats;
+
+// Time of the last scan (in ticks) and the time the current rate was entered or last activity was seen (in milliseconds).
+static uint16_t last_scan_tick = 0;
+static uint16_t level_start_ms = 0;
+
+// Run the cpu at full speed, or at 1/8 with the timers rescaled to keep time (see governor.h).
+static void set_clock(bool slow)
+{
+#ifdef GOVERNOR_SLOW_CLOCK
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(slow == governor_stats.slow_clock) return;
+
+		clock_prescale_set(slow ? clock_div_8 : clock_div_1);
+		systick_slow_clock(slow);
+		leds_slow_clock(slow);
+		governor_stats.slow_clock = slow;
+	}
+#endif
+}
+
+// Start at the fastest rate.
+void governor_init(void)
+{
+	governor_stats.level = 0;
+	governor_stats.level_entries[0]++;
+	last_scan_tick = systick_ticks();
+	level_start_ms = systick_ms();
+}
+
+// Returns true (and restarts the interval) if the matrix should be scanned now.
+bool governor_scan_due(void)
+{
+	uint16_t now = systick_ticks();
+
+	if((uint16_t)(now - last_scan_tick) < scan_rates[governor_stats.level].interval_ticks) return(false);
+
+	last_scan_tick = now;
+	return(true);
+}
+
+// Report the result of a scan.  Active is true if any key (column) was seen down.
+void governor_activity(bool active)
+{
+	uint16_t now = systick_ms();
+
+	if(active)
+	{
+		// Snap straight back to the fastest rate (and clock).
+		if(governor_stats.level)
+		{
+			set_clock(false);
+			governor_stats.level = 0;
+			governor_stats.level_entries[0]++;
+			governor_stats.wakeups++;
+		}
+		level_start_ms = now;
+	}
+	else if(scan_rates[governor_stats.level].hold_ms &&
+		((uint16_t)(now - level_start_ms) >= scan_rates[governor_stats.level].hold_ms))
+	{
+		// Idle for long enough, step down to the next slower rate.
+		governor_stats.level++;
+		governor_stats.level_entries[governor_stats.level]++;
+		level_start_ms = now;
+		if(governor_stats.level >= GOVERNOR_SLOW_LEVEL) set_clock(true);
+	}
+}
+
+// Returns true if the governor has stepped down from the fastest rate.
+bool governor_idle(void)
+{
+	return(governor_stats.level != 0);
+}
+
+// Idle the cpu until the next interrupt (system tick, usb or button).  Peripherals keep running.
+void governor_sleep(void)
+{
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_mode();
+}
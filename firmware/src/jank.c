@@ -1,38 +1,46 @@
 #include "jank.h"
 
-// This interrupt sub-routine is triggered by a counter configured to vary the PWM signal used to control the brightness of the
-// LEDs.  When enabled this creates a pulsing effect with the LEDs.
-ISR(PULSER_INT_VECTOR)
+// This interrupt sub-routine is triggered by the system tick timer (SYSTICK_HZ).  It advances the time base used for scheduling
+// scans and debouncing, and every millisecond moves on the led effects and the mouse keys.
+ISR(SYSTICK_INT_VECTOR)
 {
-	leds_handle_pulser_interrupt();
+	PROFILE_ISR_PROBE(PROBE_SYSTICK_ISR);
+
+	if(systick_handle_interrupt())
+	{
+		leds_tick();
+		mousekey_tick();
+	}
 }
 
 // This interrupt sub-routine is trigerred when the dimmer/brightness button is pressed.  Pressing the button cycles the pwm duty
-// cycle through various values, effectively stepping through various brigntness values of the LEDs.  Note the PWM signal controls a
-// PNP transistor on the anode side of the LEDs, therefore duty cycle 255 = off.
+// cycle through various values, effectively stepping through various brigntness values of the LEDs.  The 12-bit duty cycle runs from
+// 0 = off to LEDS_PWM_MAX = full brightness.  The interrupt only notes that the pin changed - the button is de-bounced and acted on
+// by leds_button_task() in the main loop, so it never holds up the system tick or the usb interface.
 ISR(BUTTON_PCI_VECTOR)
 {
-	// Button de-bounce.
-	_delay_ms(BUTTON_DEBOUNCE_MS);
-
-	// If the button is still pressed (i.e. not a bounce or a release), change the mode.
-	if(leds_button_state()) leds_change_mode();
-
-	// Keep the usb interface alive whilst waiting until the button is released.
-	while(leds_button_state())
-	{
-		HID_Task();
-		USB_USBTask();
-	}
+	leds_button_changed();
 }
 
 // Initialise the hardware peripherals.
 void hardware_init(void)
 {
 	clock_prescale_set(clock_div_1);	// Ensure no pre-scaling (run full speed - 16MHz).
+	boot_start();				// Defined in boot.c
+
+	// USB first, so the host can debounce the attach and start enumerating whilst everything else is set up.
+	SetupHIDHardware();			// Defined in Keyboard.c
+	boot_mark(BOOT_MARK_USB);
+
+	settings_init();			// Defined in settings.c
 	leds_init();				// Defined in leds.c
 	keyscan_init();				// Defined in keyscan.c
-	SetupHIDHardware();			// Defined in Keyboard.c
+	boot_mark(BOOT_MARK_KEYSCAN);
+
+	macrostore_init();			// Defined in macrostore.c
+	systick_init();				// Defined in systick.c
+	governor_init();			// Defined in governor.c
+	boot_mark(BOOT_MARK_INIT);
 }
 
 // Main program entry point.
@@ -45,5 +53,13 @@ int main(void)
 	{
 		HID_Task();	// In Keyboard.c
 		USB_USBTask();	// In the lufa library.
+		settings_task();	// In settings.c
+		remap_task();		// In remap.c
+		bounce_task();		// In bounce.c
+		macrostore_task();	// In macrostore.c
+		leds_button_task();	// In leds.c
+
+		// Whilst the keys are idle there is nothing to do until the next interrupt, so sleep until then.
+		if(governor_idle()) governor_sleep();
 	}
 }
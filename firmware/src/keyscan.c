@@ -2,115 +2,501 @@
 // Converting the desired key-presses into HID reports is handled by the Keyboard.c and Keyboard.h files.
 
 #include "keyscan.h"
+#include "events.h"
+#include "remap.h"
+
+// Scanner diagnostics - see keyscan_stats_t in keyscan.h.
+keyscan_stats_t keyscan_stats;
+
+// The current keypresses, used for creating both the keyboard and media controller reports.
+keyscan_report_t keyscan_report;
+
+// The key in each slot of the report, the keys held beyond MAX_KEYS (in the order they went down) and the number of keys holding
+// each modifier.  Several keys (on different layers, or a combo and one of its keys) can send the same usage, so each usage in a
+// slot or waiting for one has a count of the keys holding it, as do the consumer usages in the report.
+static uint8_t key_slots[MAX_KEYS];
+static uint8_t key_holds[MAX_KEYS];
+static uint8_t overflow_keys[KEYSCAN_OVERFLOW];
+static uint8_t overflow_holds[KEYSCAN_OVERFLOW];
+static uint8_t overflow_count = 0;
+static uint8_t modifier_holds[8];
+static uint8_t consumer_holds[MAX_CONSUMER_KEYS];
+
+// The state of the key matrix from the last scan.  Bit c of matrix[r] is set if the key at row r, column c is down.
+matrix_row_t matrix[MATRIX_ROWS];
+
+// The system tick when each key last went down or up, for debouncing each key on its own (see bounce.h).
+static uint16_t key_edge_tick[MATRIX_KEYS];
+
+// The pin code of each row and column (see keymap.h).
+static const uint8_t matrix_row_pins[MATRIX_ROWS] = MATRIX_ROW_PINS;
+static const uint8_t matrix_col_pins[MATRIX_COLS] = MATRIX_COL_PINS;
+
+#ifdef MATRIX_SINGLE_PORT
+// With every row on ROWS_PORT and every column on COLS_PINS (so at most 8 of each) the scan is written out row by row and column by
+// column, so that every pin mask is a constant folded from the pin codes.  Rows and columns past the last have a mask of 0.
+#if (MATRIX_ROWS > 8) || (MATRIX_COLS > 8)
+#error "MATRIX_SINGLE_PORT allows at most 8 rows and 8 columns."
+#endif
+#define ROW_MASK(r)	(((r) < MATRIX_ROWS) ? PIN_CODE_MASK(matrix_row_pins[((r) < MATRIX_ROWS) ? (r) : 0]) : 0)
+#define COL_MASK(c)	(((c) < MATRIX_COLS) ? PIN_CODE_MASK(matrix_col_pins[((c) < MATRIX_COLS) ? (c) : 0]) : 0)
+#define ROWS_MASK	(ROW_MASK(0) | ROW_MASK(1) | ROW_MASK(2) | ROW_MASK(3) | ROW_MASK(4) | ROW_MASK(5) | ROW_MASK(6) | ROW_MASK(7))
+#define COLS_MASK	(COL_MASK(0) | COL_MASK(1) | COL_MASK(2) | COL_MASK(3) | COL_MASK(4) | COL_MASK(5) | COL_MASK(6) | COL_MASK(7))
+#else
+// Pin masks for each row and column, worked out from the pin codes once by keyscan_init() so that the scan itself never has to
+// decode a pin code.
+static uint8_t row_masks[MATRIX_ROWS];
+static uint8_t col_masks[MATRIX_COLS];
+static volatile uint8_t *row_ports[MATRIX_ROWS];	// PORTx register of each row.  The PINx register is two addresses below.
+static volatile uint8_t *col_port_pins[COL_PORTS];	// PINx register of each port that has at least one column pin.
+static uint8_t col_port_masks[COL_PORTS];		// Every column pin on each of those ports.
+static uint8_t col_port_index[MATRIX_COLS];		// Index into col_port_pins[] of each column.
+static uint8_t num_col_ports;
+#define ROW_MASK(r)	row_masks[r]
+#endif
+
+// Set low a row (enable check).
+static inline void row_drive(uint8_t r)
+{
+#ifdef MATRIX_SINGLE_PORT
+	ROWS_PORT &= ~ROW_MASK(r);
+#else
+	*row_ports[r] &= ~ROW_MASK(r);
+#endif
+}
+
+// Set high a row (disable check).
+static inline void row_release(uint8_t r)
+{
+#ifdef MATRIX_SINGLE_PORT
+	ROWS_PORT |= ROW_MASK(r);
+#else
+	*row_ports[r] |= ROW_MASK(r);
+#endif
+}
+
+// Release row r and drive row r + 1 (if there is one).  With a single row port this is one write so the next row starts settling
+// straight away.
+static inline void row_advance(uint8_t r)
+{
+#ifdef MATRIX_SINGLE_PORT
+	ROWS_PORT = (ROWS_PORT | ROW_MASK(r)) & ~ROW_MASK(r + 1);
+#else
+	row_release(r);
+	if(r < (MATRIX_ROWS - 1)) row_drive(r + 1);
+#endif
+}
+
+// Returns true once a driven row reads back low.
+static inline bool row_is_low(uint8_t r)
+{
+#ifdef MATRIX_SINGLE_PORT
+	return(!(ROWS_PINS & ROW_MASK(r)));
+#else
+	return(!(*(row_ports[r] - 2) & ROW_MASK(r)));
+#endif
+}
+
+// Latch the raw state of every column port into raw[] (a bit set for each column pin pulled low).  Returns non-zero if any column
+// is active.  This is the only part of the scan that must happen while a row is driven, so it is kept to one read per port.
+static inline uint8_t cols_latch(uint8_t *raw)
+{
+#ifdef MATRIX_SINGLE_PORT
+	return(raw[0] = (~COLS_PINS & COLS_MASK));
+#else
+	uint8_t any = 0;
+	for(uint8_t p = 0; p < num_col_ports; p++) any |= (raw[p] = (~*col_port_pins[p] & col_port_masks[p]));
+	return(any);
+#endif
+}
+
+// Convert latched column ports into a packed row - bit c set if column c is active.  Only needed for rows with a key down.
+static inline matrix_row_t cols_gather(const uint8_t *raw)
+{
+	matrix_row_t row = 0;
+
+#ifdef MATRIX_SINGLE_PORT
+	// Column by column, each a test of a constant bit.
+	if(raw[0] & COL_MASK(0)) row |= 0x01;
+	if(raw[0] & COL_MASK(1)) row |= 0x02;
+	if(raw[0] & COL_MASK(2)) row |= 0x04;
+	if(raw[0] & COL_MASK(3)) row |= 0x08;
+	if(raw[0] & COL_MASK(4)) row |= 0x10;
+	if(raw[0] & COL_MASK(5)) row |= 0x20;
+	if(raw[0] & COL_MASK(6)) row |= 0x40;
+	if(raw[0] & COL_MASK(7)) row |= 0x80;
+#else
+	// Count the active columns, and stop once the last of them has been found.
+	uint8_t active = 0;
+	uint8_t found = 0;
+
+	for(uint8_t p = 0; p < num_col_ports; p++) active += __builtin_popcount(raw[p]);
+	for(uint8_t c = 0; found < active; c++)
+	{
+		if(raw[col_port_index[c]] & col_masks[c])
+		{
+			row |= ((matrix_row_t)1 << c);
+			found++;
+		}
+	}
+#endif
+
+	return(row);
+}
 
 // Initialise the gpio for scanning rows and columns.
 void keyscan_init(void)
 {
+#ifdef MATRIX_SINGLE_PORT
 	// Set rows as outputs and initialise all as high (disabled).
-	ROWS_DDR |= ((1 << ROW0) | (1 << ROW1) | (1 << ROW2) | (1 << ROW3) | (1 << ROW4) | (1 << ROW5));
-	ROWS_PORT |= ((1 << ROW0) | (1 << ROW1) | (1 << ROW2) | (1 << ROW3) | (1 << ROW4) | (1 << ROW5));
+	ROWS_DDR |= ROWS_MASK;
+	ROWS_PORT |= ROWS_MASK;
 
 	// Set columns as inputs and enable pull-ups.
-	COLS_DDR &= ~((1 << COL0) | (1 << COL1) | (1 << COL2) | (1 << COL3));
-	COLS_PORT |= ((1 << COL0) | (1 << COL1) | (1 << COL2) | (1 << COL3));
+	COLS_DDR &= ~COLS_MASK;
+	COLS_PORT |= COLS_MASK;
+#else
+	// Set rows as outputs and initialise all as high (disabled).
+	for(uint8_t r = 0; r < MATRIX_ROWS; r++)
+	{
+		row_masks[r] = PIN_CODE_MASK(matrix_row_pins[r]);
+		*PIN_CODE_DDR(matrix_row_pins[r]) |= row_masks[r];
+		*PIN_CODE_PORTS(matrix_row_pins[r]) |= row_masks[r];
+		row_ports[r] = PIN_CODE_PORTS(matrix_row_pins[r]);
+	}
+
+	// Set columns as inputs and enable pull-ups.
+	for(uint8_t c = 0; c < MATRIX_COLS; c++)
+	{
+		col_masks[c] = PIN_CODE_MASK(matrix_col_pins[c]);
+		*PIN_CODE_DDR(matrix_col_pins[c]) &= ~col_masks[c];
+		*PIN_CODE_PORTS(matrix_col_pins[c]) |= col_masks[c];
+
+		// Find (or add) the port this column is on, so that each port is read only once per row.
+		uint8_t p = 0;
+		while((p < num_col_ports) && (col_port_pins[p] != PIN_CODE_PINS(matrix_col_pins[c]))) p++;
+		if(p == num_col_ports) col_port_pins[num_col_ports++] = PIN_CODE_PINS(matrix_col_pins[c]);
+		col_port_masks[p] |= col_masks[c];
+		col_port_index[c] = p;
+	}
+#endif
+
+	// Measure the row propagation delay so that KEYSCAN_SETTLE_CYCLES can be checked against the actual board.
+	keyscan_calibrate();
+
+	// Load the keymap, with any stored overrides, into RAM.
+	remap_init();
+
+	// Load the debounce window of each key.
+	bounce_init();
+
+	// Start the key event pipeline on the base layer.
+	events_init();
 }
 
-// Parse the detected key and update the appropriate part of the report struct.
-void handle_key(char key, keyscan_report_t *keyscan_report)
+// Drive each row low in turn and time, in cpu cycles, how long it takes before the row pin reads back low.  The worst case is
+// recorded in keyscan_stats.row_settle_cycles, to compare directly with KEYSCAN_SETTLE_CYCLES.  The system tick timer is not
+// started until after keyscan_init(), so it is borrowed here to count at the full cpu clock.  The count includes the few cycles
+// taken to drive the row and test the pin, so it errs long.
+void keyscan_calibrate(void)
 {
-	// Media key scan values start at 0xF0, after the last keyboard modifier key scan.
-	if(key > HID_KEYBOARD_SC_RIGHT_GUI)
+	keyscan_stats.row_settle_cycles = 0;
+
+	for(uint8_t r = 0; r < MATRIX_ROWS; r++)
 	{
-		// Convert the media key to a value from 0 to 10.
-		key -= HID_MEDIACONTROLLER_SC_PLAY;
+		// Set low current row and count until it reads back low (give up on a stuck row).
+		SYSTICK_COUNT = 0;
+		SYSTICK_TCCRB = (1 << SYSTICK_CS0);
+		row_drive(r);
+		while(!row_is_low(r) && (SYSTICK_COUNT < KEYSCAN_STUCK_CYCLES)) {}
+		uint16_t cycles = SYSTICK_COUNT;
+		SYSTICK_TCCRB = 0;
+		row_release(r);
 
-		// Shift a bit to the corresponding bit within the media_keys integer.
-		keyscan_report->media_keys |= (1 << key);
+		if(cycles > keyscan_stats.row_settle_cycles) keyscan_stats.row_settle_cycles = cycles;
 	}
 
-	// Modifier keys scan values start at 0xE0, after the last keyboard modifier key scan.
-	else if(key > HID_KEYBOARD_SC_APPLICATION)
-	{
-		// Convert the media key to a value from 0 to 7.
-		key -= HID_KEYBOARD_SC_LEFT_CONTROL;
+	// Leave the timer as it was found for systick_init().
+	SYSTICK_COUNT = 0;
+}
+
+// Sample row r and return its packed columns.  With KEYSCAN_PIPELINED row r is already driven, and row r + 1 is left driven.
+static inline __attribute__((always_inline)) matrix_row_t sample_row(uint8_t r)
+{
+	uint8_t raw[COL_PORTS];
+
+#ifdef KEYSCAN_PIPELINED
+	uint8_t idle[COL_PORTS];
 
-		// Shift a bit to the corresponding bit within the modifier integer.
-		keyscan_report->modifier |= (1 << key);
+	// Fixed settle time instead of spinning on the row pin.  Also covers the columns recovering from the previous row.
+	__builtin_avr_delay_cycles(KEYSCAN_SETTLE_CYCLES);
+
+	// Latch the columns for the current row.  With nothing down there is nothing for the columns to recover from, so release the
+	// current row and drive the next one.
+	if(!cols_latch(raw))
+	{
+		row_advance(r);
+		return(0);
 	}
 
-	// Regular keys scan values range from 0x00 to 0x65.
-	else  if(key > HID_KEYBOARD_SC_RESERVED)
+	// A key is down, so release the row on its own first.  With no row driven every column should be pulled back high within the
+	// settle time.  If not, the settle time is too short for this board (the next row would see a ghost of this one) so record it.
+	row_release(r);
+	__builtin_avr_delay_cycles(KEYSCAN_SETTLE_CYCLES);
+	if(cols_latch(idle)) keyscan_stats.recovery_faults++;
+
+	// Drive the next row, then decode the latched columns whilst it settles.
+	if(r < (MATRIX_ROWS - 1)) row_drive(r + 1);
+	return(cols_gather(raw));
+#else
+	// Set low current row (enable check).
+	row_drive(r);
+
+	// Wait until row is set low before continuing, otherwise column checks can be missed.
+	while(!row_is_low(r)) {}
+
+	// Latch the columns for the current row.
+	uint8_t any = cols_latch(raw);
+
+	// Set high current row (disable check).
+	row_release(r);
+
+	return(any ? cols_gather(raw) : 0);
+#endif
+}
+
+// Sample the whole matrix.  On return bit c of samples[r] is set if the key at row r, column c is down.  The cost grows with the
+// number of rows (and column ports), columns are only decoded for rows that have a key down.
+void keyscan_sample_matrix(matrix_row_t *samples)
+{
+#ifdef KEYSCAN_PIPELINED
+	// Set low the first row (enable check).
+	row_drive(0);
+#endif
+
+#ifdef MATRIX_SINGLE_PORT
+	// Row by row, so that every mask is a constant.
+	samples[0] = sample_row(0);
+#if (MATRIX_ROWS > 1)
+	samples[1] = sample_row(1);
+#endif
+#if (MATRIX_ROWS > 2)
+	samples[2] = sample_row(2);
+#endif
+#if (MATRIX_ROWS > 3)
+	samples[3] = sample_row(3);
+#endif
+#if (MATRIX_ROWS > 4)
+	samples[4] = sample_row(4);
+#endif
+#if (MATRIX_ROWS > 5)
+	samples[5] = sample_row(5);
+#endif
+#if (MATRIX_ROWS > 6)
+	samples[6] = sample_row(6);
+#endif
+#if (MATRIX_ROWS > 7)
+	samples[7] = sample_row(7);
+#endif
+#else
+	for(uint8_t r = 0; r < MATRIX_ROWS; r++) samples[r] = sample_row(r);
+#endif
+}
+
+// Add a regular key to the report - one more hold of it if it is already there, otherwise in the first free slot, or after the keys
+// already waiting for one.
+static void add_key(uint8_t key)
+{
+	uint8_t i;
+
+	for(i = 0; i < MAX_KEYS; i++)
+	{
+		if(key_slots[i] != key) continue;
+		key_holds[i]++;
+		return;
+	}
+	for(i = 0; i < overflow_count; i++)
 	{
-		// Skip array elements that already have a keyscan value written.
-		uint8_t i = 0;
-		while((keyscan_report->keys[i]) && (i < MAX_KEYS)) i++;
+		if(overflow_keys[i] != key) continue;
+		overflow_holds[i]++;
+		return;
+	}
+
+	i = 0;
+	while((i < MAX_KEYS) && (key_slots[i])) i++;
 
-		// Only register the key if the maximum number of simultaneous keys is not reached.
-		if(i < MAX_KEYS) keyscan_report->keys[i] = key;
+	if(i < MAX_KEYS)
+	{
+		key_slots[i] = key;
+		key_holds[i] = 1;
+	}
+	else if(overflow_count < KEYSCAN_OVERFLOW)
+	{
+		overflow_keys[overflow_count] = key;
+		overflow_holds[overflow_count++] = 1;
 	}
 }
 
-// Returns the address of a keyscan report which contains the key/modifier key-presses to be sent to the host.
-void create_keyscan_report(keyscan_report_t *keyscan_report)
+// Remove a hold of a regular key, and the key from the report once nothing holds it.  A slot it frees goes to the first key waiting
+// for one, and no other key moves.
+static void remove_key(uint8_t key)
 {
-	// Start with a blank keyscan report.
-	memset(keyscan_report, 0, sizeof(keyscan_report_t));
+	uint8_t i = 0;
+	while((i < MAX_KEYS) && (key_slots[i] != key)) i++;
 
-	// Loop through for each row.
-	for(uint8_t r = 0; r < sizeof(key_row_array); r++)
+	if(i < MAX_KEYS)
 	{
-		// Set low current row (enable check).
-		ROWS_PORT &= ~(1 << key_row_array[r]);
+		if(--key_holds[i]) return;
 
-		// Wait until row is set low before continuing, otherwise column checks can be missed.
-		while(!(~ROWS_PINS & (1 << key_row_array[r]))) {}
-
-		// Loop through for each column in the current row.
-		for(uint8_t c = 0; c < sizeof(key_col_array); c++)
+		key_slots[i] = (overflow_count ? overflow_keys[0] : 0);
+		key_holds[i] = (overflow_count ? overflow_holds[0] : 0);
+		if(overflow_count)
 		{
-			// If the button in the current row and column is pressed, handle it.
-			if(~COLS_PINS & (1 << key_col_array[c]))
-			{
-				// Determine desired keypresses.
-				handle_key(pgm_read_byte(&KEYMAP[r][c]), keyscan_report);
-			}
+			overflow_count--;
+			memmove(overflow_keys, &overflow_keys[1], overflow_count);
+			memmove(overflow_holds, &overflow_holds[1], overflow_count);
 		}
+		return;
+	}
 
-		// Set high current row (disable check).
-		ROWS_PORT |= (1 << key_row_array[r]);
+	for(i = 0; i < overflow_count; i++)
+	{
+		if(overflow_keys[i] != key) continue;
+		if(--overflow_holds[i]) return;
+
+		overflow_count--;
+		memmove(&overflow_keys[i], &overflow_keys[i + 1], (overflow_count - i));
+		memmove(&overflow_holds[i], &overflow_holds[i + 1], (overflow_count - i));
+		return;
 	}
 }
 
-// Returns the address of a macro, i.e. first character in a string to be "typed".
-// Note: only the first detected macro will be registered.  I.e. simultaneous macro key-presses is not possible.
-const macro_t *scan_macro_keys(void)
+// Add a hold of a consumer usage (pressed = true), in its slot of the report if it is already there or else the first free slot.  Or
+// remove a hold, freeing the slot once nothing holds it.  Usages beyond MAX_CONSUMER_KEYS are not reported.
+static void handle_consumer_key(uint16_t usage, bool pressed)
 {
-	// Loop through for each row.
-	for(uint8_t r = 0; r < sizeof(macro_row_array); r++)
+	uint8_t i = 0;
+
+	while((i < MAX_CONSUMER_KEYS) && (keyscan_report.consumer_keys[i] != usage)) i++;
+
+	if(!pressed)
+	{
+		if((i == MAX_CONSUMER_KEYS) || --consumer_holds[i]) return;
+		keyscan_report.consumer_keys[i] = 0;
+	}
+	else if(i < MAX_CONSUMER_KEYS)
+	{
+		consumer_holds[i]++;
+		return;
+	}
+	else
+	{
+		i = 0;
+		while((i < MAX_CONSUMER_KEYS) && keyscan_report.consumer_keys[i]) i++;
+		if(i == MAX_CONSUMER_KEYS) return;
+
+		keyscan_report.consumer_keys[i] = usage;
+		consumer_holds[i] = 1;
+	}
+	keyscan_report.consumer_changed = true;
+}
+
+// Parse a key that went down (pressed = true) or up and update the appropriate part of the report struct.
+void handle_key(keycode_t key, bool pressed)
+{
+	PROFILE_PROBE(PROBE_HANDLE_KEY);
+
+	// Consumer keys carry their usage, which goes straight into the media controller report.
+	if(KC_IS_CONSUMER(key))
+	{
+		handle_consumer_key(KC_CONSUMER_USAGE(key), pressed);
+		return;
+	}
+
+	// Mouse keys go to the mouse interface.
+	if(KC_KIND(key) == KC_MOUSE)
+	{
+		mousekey_key(KC_ARG(key), pressed);
+		return;
+	}
+
+	// Layer keys and other special functions are not reported to the host.
+	if(key > KC_BASIC_MAX) return;
+
+	// Modifier keys scan values start at 0xE0, after the last keyboard modifier key scan.
+	if((key >= HID_KEYBOARD_SC_LEFT_CONTROL) && (key <= HID_KEYBOARD_SC_RIGHT_GUI))
 	{
-		// Set low current row (enable check).
-		ROWS_PORT &= ~(1 << macro_row_array[r]);
+		// Convert the modifier key to a value from 0 to 7.
+		key -= HID_KEYBOARD_SC_LEFT_CONTROL;
+
+		// The modifier is down whilst any key holds it.
+		if(pressed)			modifier_holds[key]++;
+		else if(modifier_holds[key])	modifier_holds[key]--;
+
+		if(modifier_holds[key])	keyscan_report.modifier |= (1 << key);
+		else			keyscan_report.modifier &= ~(1 << key);
+		keyscan_report.keys_changed = true;
+	}
 
-		// Wait until row is set low before continuing, otherwise column checks can be missed.
-		while(!(~ROWS_PINS & (1 << macro_row_array[r]))) {}
+	// Macro keys (and unused scan values) are not part of the report.
+	else if(key > HID_KEYBOARD_SC_APPLICATION) return;
 
-		// Loop through for each column in the current row.
-		for(uint8_t c = 0; c < sizeof(macro_col_array); c++)
+	// Regular keys scan values range from 0x00 to 0x65.
+	else  if(key > HID_KEYBOARD_SC_RESERVED)
+	{
+		if(pressed)	add_key(key);
+		else		remove_key(key);
+
+		// Whilst more keys are down than the report has slots for, report error-rollover in every slot.
+		if(overflow_count)	memset(keyscan_report.keys, HID_KEYBOARD_SC_ERROR_ROLLOVER, MAX_KEYS);
+		else			memcpy(keyscan_report.keys, key_slots, MAX_KEYS);
+		keyscan_report.keys_changed = true;
+	}
+}
+
+// Scans the matrix and passes any keys that went down or up through the event pipeline, which updates keyscan_report (via
+// handle_key()) as it applies them.  Macro keys start their macros as they are registered by the event pipeline (see macroplay.h).
+// Returns true if any column was active (i.e. any key down), which is used by the scan governor.
+bool create_keyscan_report(void)
+{
+	PROFILE_PROBE(PROBE_SCAN);
+
+	bool active = false;
+	matrix_row_t samples[MATRIX_ROWS];
+	uint16_t now = systick_ticks();
+
+	// Sample the whole matrix first, then decode it.
+	keyscan_sample_matrix(samples);
+
+	// Whilst the bounce profiler is running it sees every sample.
+	if(bounce_profiling) bounce_sample(samples, now);
+
+	// Loop through for each row.
+	for(uint8_t r = 0; r < MATRIX_ROWS; r++)
+	{
+		matrix_row_t row = samples[r];
+		matrix_row_t changed = row ^ matrix[r];		// Keys that went down or up since the last scan.
+		if(row) active = true;
+
+		// Pass each key that went down or up into the event pipeline.  A key is debounced on its own: the first edge is taken
+		// straight away, then further edges on the same key are ignored (and picked up by a later scan if the key has really
+		// changed) for the key's debounce window (the longest window whilst the bounce profiler runs).
+		uint8_t key = r * MATRIX_COLS;
+		for(matrix_row_t bit = 1; changed; key++, bit <<= 1, changed >>= 1)
 		{
-			// If the button in the current row and column is pressed, handle it.
-			if(~COLS_PINS & (1 << macro_col_array[c]))
-			{
-				// Returns the address of the desired macro array.
-				return(&MACROMAP[r][c][0]);
-			}
-		}
+			if(!(changed & 1)) continue;
+			if((uint16_t)(now - key_edge_tick[key]) < (bounce_profiling ? BOUNCE_MAX_TICKS : bounce_window[key])) continue;
 
-		// Set high current row (disable check).
-		ROWS_PORT |= (1 << macro_row_array[r]);
+			key_edge_tick[key] = now;
+			matrix[r] ^= bit;
+			events_key(key, (row & bit));
+		}
 	}
 
-	// If no macro key pressed, return 0.
-	return(0);
+	// Apply the next batch of key events to the report.
+	events_apply();
+
+	return(active);
 }
 
 // Converts a character to a keyboard scancode.
@@ -0,0 +1,118 @@
+// The layer engine resolves a key (numbered (row * MATRIX_COLS) + column) to a keycode from the flattened keymap in RAM.  Resolution
+// only happens when a key goes down.  The keycode it resolved to is remembered so that the key is released (and reported whilst
+// held) as the same keycode, however the active layers or the keymap itself (see remap.h) change in the meantime.  The layer
+// functions themselves (MO, TG, OSL and held LT keys) are actioned by the key event pipeline in events.c.
+
+#include "layers.h"
+
+// Momentary and toggled layers, and one-shot layers waiting for the next key press.  Layer 0 is always active.
+static layer_state_t layer_state = 1;
+static layer_state_t oneshot_state = 0;
+
+// The highest active layer, updated whenever the layer state changes so that a press is normally a single keymap read.
+static uint8_t top_layer = 0;
+
+// The keycode each key resolved to when it went down.
+static keycode_t key_keycodes[MATRIX_KEYS];
+
+// Read a keycode from the flattened keymap (the RAM copy, which includes any runtime overrides).
+static inline keycode_t keymap_read(uint8_t layer, uint8_t key)
+{
+	return(keymap_ram[((uint16_t)layer * MATRIX_KEYS) + key]);
+}
+
+// Recalculate the highest active layer.
+static void layers_update(void)
+{
+	layer_state_t state = (layer_state | oneshot_state | 1);
+
+	top_layer = keymap_num_layers - 1;
+	while(!(state & (1 << top_layer))) top_layer--;
+}
+
+// Start with only the base layer active.
+void layers_init(void)
+{
+	layer_state = 1;
+	oneshot_state = 0;
+	layers_update();
+}
+
+// Look a key up through the active layers without remembering the result.
+static keycode_t layers_lookup(uint8_t key)
+{
+	layer_state_t state = (layer_state | oneshot_state | 1);
+	uint8_t layer = top_layer;
+	keycode_t keycode = keymap_read(layer, key);
+
+	// Fall through transparent keys to the next lower active layer.
+	while((keycode == KC_TRNS) && layer)
+	{
+		layer--;
+		if(state & (1 << layer)) keycode = keymap_read(layer, key);
+	}
+	if(keycode == KC_TRNS) keycode = 0x00;
+
+	return(keycode);
+}
+
+// Returns the keycode a key would resolve to if it went down now.
+keycode_t layers_peek(uint8_t key)
+{
+	return(layers_lookup(key));
+}
+
+// Resolve a key that has just gone down.  The keycode is remembered so that layers_keycode() returns it until the key is next
+// resolved.  Layer functions of the keycode are actioned by the caller (see events.c).
+keycode_t layers_resolve(uint8_t key)
+{
+	return(key_keycodes[key] = layers_lookup(key));
+}
+
+// Returns the keycode of a key that is being held, as it resolved when pressed.
+keycode_t layers_keycode(uint8_t key)
+{
+	return(key_keycodes[key]);
+}
+
+// Turn a layer on (momentary or held dual-role keys).
+void layers_on(uint8_t layer)
+{
+	if(layer < keymap_num_layers) layer_state |= (1 << layer);
+	layers_update();
+}
+
+// Turn a layer off.  The base layer stays on.
+void layers_off(uint8_t layer)
+{
+	if(layer) layer_state &= ~(1 << layer);
+	layers_update();
+}
+
+// Toggle a layer.
+void layers_toggle(uint8_t layer)
+{
+	if(layer && (layer < keymap_num_layers)) layer_state ^= (1 << layer);
+	layers_update();
+}
+
+// Make a layer active for the next key press only.
+void layers_oneshot(uint8_t layer)
+{
+	if(layer < keymap_num_layers) oneshot_state |= (1 << layer);
+	layers_update();
+}
+
+// A key has been pressed - any pending one-shot layer is used up.
+void layers_oneshot_clear(void)
+{
+	if(!oneshot_state) return;
+	oneshot_state = 0;
+	layers_update();
+}
+
+// Returns the active layers.
+layer_state_t layers_state(void)
+{
+	return(layer_state | oneshot_state | 1);
+}
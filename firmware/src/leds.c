@@ -1,27 +1,99 @@
 #include "leds.h"
+#include "settings.h"
 
-// Each "mode" is defined by a uint8_t for brightness and a uint16_t for pulse speed.
-// initial_brightness:	The PWM value to send to the LEDs before setting the pulse speed.  Note, the LEDs are active low, so full
-//			brightness requires a value of 0xFF.  Range is 0 to 255 (0x00 to 0xFF).
-// pulse_speed:		When the pulse timer counter reaches this value, an interrupt is triggered that changes the PWM value.
-//			Set to zero for no pulse effect.  Range is 0 to 65535 (0x0000 to 0xFFFF).
+// Each "mode" is defined by a uint16_t for brightness and a uint8_t for pulse speed.
+// initial_brightness:	The PWM value to send to the LEDs before setting the pulse speed.  The 12-bit OC1C output is non-inverting, so
+//			the value is how much of each period the LEDs are lit: 0 is off and LEDS_PWM_MAX is full brightness.  Range
+//			is 0 to LEDS_PWM_MAX (0x000 to 0xFFF).  The steps are roughly even in perceived brightness.
+// pulse_speed:		PWM steps the brightness moves every millisecond whilst pulsing, e.g. 4 takes about a second from off to
+//			full brightness.  Set to zero for no pulse effect.  Range is 0 to 255.
 const struct mode modes[] = 
 {
 	{ .initial_brightness = 0, 	.pulse_speed = 0},	// Mode 00 - Off.
-	{ .initial_brightness = 2, 	.pulse_speed = 0},	// Mode 01
-	{ .initial_brightness = 4, 	.pulse_speed = 0},	// Mode 02
-	{ .initial_brightness = 8, 	.pulse_speed = 0},	// Mode 03
-	{ .initial_brightness = 16, 	.pulse_speed = 0},	// Mode 04
-	{ .initial_brightness = 32, 	.pulse_speed = 0},	// Mode 05
-	{ .initial_brightness = 64, 	.pulse_speed = 0},	// Mode 06
-	{ .initial_brightness = 128, 	.pulse_speed = 0},	// Mode 07
-	{ .initial_brightness = 255, 	.pulse_speed = 0},	// Mode 08 - Max brightness.
-	{ .initial_brightness = 255, 	.pulse_speed = 2000},	// Mode 09 - Fast pulse.
-	{ .initial_brightness = 255, 	.pulse_speed = 8000},	// Mode 10 - Medium pulse.
-	{ .initial_brightness = 255, 	.pulse_speed = 32000},	// Mode 11 - Slow pulse.
+	{ .initial_brightness = 16, 	.pulse_speed = 0},	// Mode 01
+	{ .initial_brightness = 40, 	.pulse_speed = 0},	// Mode 02
+	{ .initial_brightness = 96, 	.pulse_speed = 0},	// Mode 03
+	{ .initial_brightness = 224, 	.pulse_speed = 0},	// Mode 04
+	{ .initial_brightness = 480, 	.pulse_speed = 0},	// Mode 05
+	{ .initial_brightness = 1024, 	.pulse_speed = 0},	// Mode 06
+	{ .initial_brightness = 2048, 	.pulse_speed = 0},	// Mode 07
+	{ .initial_brightness = 4095, 	.pulse_speed = 0},	// Mode 08 - Max brightness.
+	{ .initial_brightness = 4095, 	.pulse_speed = 16},	// Mode 09 - Fast pulse.
+	{ .initial_brightness = 4095, 	.pulse_speed = 4},	// Mode 10 - Medium pulse.
+	{ .initial_brightness = 4095, 	.pulse_speed = 1},	// Mode 11 - Slow pulse.
 
 };
 
+// The current duty cycle (at the full LEDS_PWM_BITS, whatever the clock), the pulse speed and direction, and whether the cpu clock
+// is divided down.
+static uint16_t pwm_duty = 0;
+static volatile uint8_t pulse_speed = 0;
+static int8_t pulse_direction = 1;
+static uint8_t pwm_shift = 0;
+
+// The steps of every reactive effect.  Levels are pwm duty cycles (or LEDS_LEVEL_BASE), and times are in milliseconds.
+static const leds_step_t effect_steps[] PROGMEM =
+{
+	// 0: Fade - down to the idle level, then hold it (the step repeats, from the idle level to itself).
+	{ .level = LEDS_IDLE_LEVEL,	.ms = 2000},
+	// 1: Key - flash to full brightness, and decay back to the mode.
+	{ .level = LEDS_PWM_MAX,	.ms = 0},
+	{ .level = LEDS_LEVEL_BASE,	.ms = 250},
+	// 3: Macro - off and full brightness, 150ms each.
+	{ .level = 0,			.ms = 0},
+	{ .level = 0,			.ms = 150},
+	{ .level = LEDS_PWM_MAX,	.ms = 0},
+	{ .level = LEDS_PWM_MAX,	.ms = 150},
+	// 7: Lock on - a blink, then on into lock off.
+	{ .level = LEDS_PWM_MAX,	.ms = 0},
+	{ .level = LEDS_PWM_MAX,	.ms = 120},
+	{ .level = 0,			.ms = 0},
+	{ .level = 0,			.ms = 120},
+	// 11: Lock off - a blink, then back to the mode.
+	{ .level = LEDS_PWM_MAX,	.ms = 0},
+	{ .level = LEDS_PWM_MAX,	.ms = 120},
+	{ .level = 0,			.ms = 0},
+	{ .level = 0,			.ms = 120},
+	{ .level = LEDS_LEVEL_BASE,	.ms = 200},
+};
+
+// The effects, as runs of the steps above.
+static const leds_effect_t effects[LEDS_NUM_EFFECTS] PROGMEM =
+{
+	[LEDS_EFFECT_FADE]	= { .first = 0,		.count = 1,	.repeat = true},
+	[LEDS_EFFECT_KEY]	= { .first = 1,		.count = 2,	.repeat = false},
+	[LEDS_EFFECT_MACRO]	= { .first = 3,		.count = 4,	.repeat = true},
+	[LEDS_EFFECT_LOCK_OFF]	= { .first = 11,	.count = 5,	.repeat = false},
+	[LEDS_EFFECT_LOCK_ON]	= { .first = 7,		.count = 9,	.repeat = false},
+};
+
+// What the rest of the firmware has noted since the last tick: the highest effect asked for, a key press, and whether macros are
+// playing.
+static volatile uint8_t requested = LEDS_EFFECT_NONE;
+static volatile bool key_pressed = false;
+static volatile bool macro_running = false;
+
+// The effect playing (only ever touched by the system tick, once running): its step, the milliseconds left of the step, and the
+// brightness and its change per millisecond with 8 bits of fraction.  A step back to the mode's brightness is played as an offset
+// from it (relative) which runs down to zero, so it ends on the mode's brightness even whilst that pulses.
+static uint8_t effect = LEDS_EFFECT_NONE;
+static uint8_t step;
+static uint16_t step_ms;
+static int32_t level;
+static int32_t target;
+static int32_t delta;
+static bool relative;
+
+// Milliseconds since the last key press (stops at LEDS_IDLE_MS), the duty cycle last shown, and whether the mode allows effects.
+static uint16_t idle_ms = 0;
+static uint16_t shown = 0;
+static bool effects_allowed = false;
+
+// The mode button: set by the pin-change interrupt whenever the pin changes, the state last acted on and when the pin last changed.
+static volatile bool button_changed = false;
+static bool button_down = false;
+static uint16_t button_change_ms;
+
 // Initialise the AVR registers for controlling the LEDs.
 // The hardware configuration has the pwm pin connected to a PNP transistor that controls all LEDs on the anode side.
 void leds_init(void)
@@ -33,81 +105,239 @@ void leds_init(void)
 
 	////////Initialise the pwm timer.
 	PWM_DDR |= (1 << PWM_PIN);	// Set the PWM pin as an output.
-	// WGM[2:0] set to 111	: Fast PWM mode with TOP value set by output compare register.
-	// COM[1:0] set to 10	: Clear on compare match, set output pin at TOP.
-	// CS[2:0] set to 011	: clk = CK/64 = 250,000Hz.  PWM_freq = clk/256 = 964.5625Hz
-	PWM_TCCRA |= ((1 << PWM_COM1) | (1 << PWM_WGM1) | (1 << PWM_WGM0));
-	PWM_TCCRB |= ((0 << PWM_WGM2) | (1 << PWM_CS1) | (1 << PWM_CS0));
+	// WGM[3:0] set to 1110	: Fast PWM mode with TOP value set by the input capture register.
+	// COM[1:0] set to 10	: Clear on compare match, set output pin at BOTTOM.
+	// CS[2:0] set to 001	: clk = CK/1 = 16MHz.  PWM_freq = clk/(TOP + 1) = 3.9kHz at 12 bits.
+	PWM_TOP = LEDS_PWM_MAX;
+	PWM_TCCRA |= ((1 << PWM_COM1) | (1 << PWM_WGM1));
+	PWM_TCCRB |= ((1 << PWM_WGM3) | (1 << PWM_WGM2) | (1 << PWM_CS0));
 
-	////////Initialise the pulse effect timer.
-	// WGM[2:0] set to 0100 : CTC mode, counts from 0 to value of output compare register.
-	// COM[1:0] set to 00 : Normal pin modes - not connected to timer.
-	// CS[2:0] set to 010 : clk/8 (from prescaler).
-	PULSER_TCCRB |= ((1 << PULSER_WGM2) | (1 << PULSER_CS1));
-
-	// Set the default (start-up) led mode.
-	leds_set_mode(START_MODE);
+	// Set the led mode saved in the settings (or the default).
+	if(settings.led_mode >= NUM_MODES) settings.led_mode = START_MODE;
+	leds_set_mode(settings.led_mode);
 
 	// Enable the led mode button.
 	leds_button_enable(true);
 }
 
-// Set the current duty cycle (0 to 255).
-void leds_pwm_set(uint8_t duty)
-{
-	PWM_SET = duty;
-}
-
-// Get the current duty cycle (0 to 255).
-uint8_t leds_pwm_get(void)
+// Set the current duty cycle (0 to LEDS_PWM_MAX).  Whilst an effect plays, this is the brightness it returns to.
+void leds_pwm_set(uint16_t duty)
 {
-	return(PWM_SET);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		pwm_duty = duty;
+		if(effect == LEDS_EFFECT_NONE)
+		{
+			shown = duty;
+			PWM_SET = (duty >> pwm_shift);
+		}
+	}
 }
 
-// Enable or disable the pulse effect.
-void leds_pulse_enable(bool enable)
+// Get the current duty cycle (0 to LEDS_PWM_MAX).
+uint16_t leds_pwm_get(void)
 {
-	if(enable)	PULSER_TIMSK |= (1 << PULSER_IE);	// Enable the output compare interrupt.
-	else		PULSER_TIMSK &= ~(1 << PULSER_IE);	// Disable the output compare interrupt.
+	return(pwm_duty);
 }
 
-// Set the counter value that will trigger the interrupt.  Also disable the interrupt if the selected speed is zero.
-void leds_pulse_speed_set(uint16_t speed)
+// Set the pwm steps per millisecond of the pulse effect.  Zero for no pulse.
+void leds_pulse_speed_set(uint8_t speed)
 {
-	PULSER_SET_REG = speed;
-
-	if(speed)	leds_pulse_enable(true);
-	else		leds_pulse_enable(false);	// Enable pulse only if speed is not zero.
+	pulse_speed = speed;
 }
 
 // Using the look-up table ("modes"), set the desired brightness (pwm value) and pulse speed.
 void leds_set_mode(uint8_t led_mode)
 {
+	leds_pulse_speed_set(0);
 	leds_pwm_set(modes[led_mode].initial_brightness);
 	leds_pulse_speed_set(modes[led_mode].pulse_speed);
+
+	// No effects whilst the backlight is off.
+	effects_allowed = (modes[led_mode].initial_brightness || modes[led_mode].pulse_speed);
 }
 
-// Update the pwm value when the pulse effect interrupt is triggered.
-void leds_handle_pulser_interrupt(void)
+// Returns true if an effect is turned on in the settings.
+static bool effect_enabled(uint8_t e)
 {
-	static int8_t led_pulse_direction = 1;	// Static so it is initiaised once but retained for future invocations.
-	uint8_t current_pwm = leds_pwm_get();	// Check the current pwm value.
+	return(settings.led_effects & (1 << e));
+}
+
+// Returns the effect to play when there is nothing else: the macro blink whilst macros play, then the idle fade once the keys are
+// idle.
+static uint8_t effect_background(void)
+{
+	if(macro_running && effect_enabled(LEDS_EFFECT_MACRO))			return(LEDS_EFFECT_MACRO);
+	else if((idle_ms >= LEDS_IDLE_MS) && effect_enabled(LEDS_EFFECT_FADE))	return(LEDS_EFFECT_FADE);
+	else									return(LEDS_EFFECT_NONE);
+}
+
+// Returns the brightness of the effect at this millisecond.
+static uint16_t effect_output(void)
+{
+	int32_t out = (level >> 8);
+
+	if(relative) out += pwm_duty;
+	if(out < 0)		return(0);
+	if(out > LEDS_PWM_MAX)	return(LEDS_PWM_MAX);
+	return(out);
+}
 
-	if	(current_pwm == 255)	led_pulse_direction = -1;	// Start decreasing.
-	else if	(current_pwm == 0)	led_pulse_direction = 1;	// Start increasing.
+// Make an effect the one playing, from its first step.  The step is started by step_start().
+static void effect_set(uint8_t e)
+{
+	effect = e;
+	if(e != LEDS_EFFECT_NONE) step = pgm_read_byte(&effects[e].first);
+}
+
+// Move on to the next step of the effect, back to its first if it repeats, or on to the background effect.
+static void step_next(void)
+{
+	leds_effect_t e;
 
-	leds_pwm_set(current_pwm + led_pulse_direction);		// Update the led brightness.
+	memcpy_P(&e, &effects[effect], sizeof(e));
+	if(++step < (e.first + e.count))	return;
+	else if(e.repeat)			step = e.first;
+	else					effect_set(effect_background());
 }
 
-// Cycle through the various led modes.
+// Start the step of the effect from the brightness last shown, going straight through any steps that jump.
+static void step_start(void)
+{
+	leds_step_t s;
+	int32_t from = ((int32_t)shown << 8);
+
+	while(effect != LEDS_EFFECT_NONE)
+	{
+		memcpy_P(&s, &effect_steps[step], sizeof(s));
+
+		relative = (s.level == LEDS_LEVEL_BASE);
+		level = (relative ? (from - ((int32_t)pwm_duty << 8)) : from);
+		target = (relative ? 0 : ((int32_t)s.level << 8));
+		if(s.ms)
+		{
+			delta = ((target - level) / s.ms);
+			step_ms = s.ms;
+			return;
+		}
+
+		level = target;
+		from = ((int32_t)effect_output() << 8);
+		step_next();
+	}
+}
+
+// Move the pulse effect and any reactive effect on by a millisecond, and show the result.  Called from the system tick interrupt.
+void leds_tick(void)
+{
+	uint8_t speed = pulse_speed;
+	uint8_t request = requested;
+
+	requested = LEDS_EFFECT_NONE;
+
+	// Ramp the mode's brightness up to full, then down to off, and back again.
+	if(speed)
+	{
+		if(pulse_direction > 0)
+		{
+			if(pwm_duty >= (LEDS_PWM_MAX - speed))	{ pwm_duty = LEDS_PWM_MAX; pulse_direction = -1; }
+			else					pwm_duty += speed;
+		}
+		else
+		{
+			if(pwm_duty <= speed)			{ pwm_duty = 0; pulse_direction = 1; }
+			else					pwm_duty -= speed;
+		}
+	}
+
+	// A key press ends the idle fade, and the idle fade starts once the keys have been idle long enough.
+	if(key_pressed)
+	{
+		key_pressed = false;
+		idle_ms = 0;
+		if(effect == LEDS_EFFECT_FADE) { effect_set(effect_background()); step_start(); }
+	}
+	else if((idle_ms < LEDS_IDLE_MS) && (++idle_ms == LEDS_IDLE_MS) && (request < LEDS_EFFECT_FADE)) request = LEDS_EFFECT_FADE;
+
+	if(!effects_allowed) effect = LEDS_EFFECT_NONE;
+	else if((request != LEDS_EFFECT_NONE) && effect_enabled(request) && (request >= effect))
+	{
+		// Start the effect asked for, replacing any of a lower priority.
+		effect_set(request);
+		step_start();
+	}
+	else if((effect == LEDS_EFFECT_MACRO) && !macro_running)
+	{
+		// The macros have finished.
+		effect_set(effect_background());
+		step_start();
+	}
+	else if(effect != LEDS_EFFECT_NONE)
+	{
+		// Move along the step, and on to the next one at its end.
+		level += delta;
+		if(!--step_ms)
+		{
+			level = target;
+			shown = effect_output();
+			step_next();
+			step_start();
+		}
+	}
+
+	shown = ((effect != LEDS_EFFECT_NONE) ? effect_output() : pwm_duty);
+	PWM_SET = (shown >> pwm_shift);
+}
+
+// Ask for an effect, to start on the next tick (of those asked for since the last tick, the highest wins).
+static void effect_request(uint8_t e)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(e > requested) requested = e;
+	}
+}
+
+// A key has been pressed.  Called by the key event pipeline.
+void leds_key(void)
+{
+	key_pressed = true;
+	effect_request(LEDS_EFFECT_KEY);
+}
+
+// Macros have started playing (running = true), or the last one has finished.  Called by the macro player.
+void leds_macro(bool running)
+{
+	macro_running = running;
+	if(running) effect_request(LEDS_EFFECT_MACRO);
+}
+
+// Num Lock or Caps Lock has gone on (on = true) or off.  Called with the host's LED report.
+void leds_lock_echo(bool on)
+{
+	effect_request(on ? LEDS_EFFECT_LOCK_ON : LEDS_EFFECT_LOCK_OFF);
+}
+
+// Cycle through the various led modes.  The mode is kept in the settings, so it is saved for the next power-up.
 void leds_change_mode(void)
 {
-	static uint8_t led_mode = START_MODE;	// Static so it is initiaised once but retained for future invocations.
+	if(settings.led_mode >= (NUM_MODES - 1))	settings.led_mode = 0;	// Cycle back to the first mode if last mode reached.
+	else						settings.led_mode++;	// Else just increment to the next mode.
 
-	if(led_mode == (NUM_MODES - 1))	led_mode = 0;	// Cycle back to the first mode if last mode reached.
-	else				led_mode++;	// Else just increment to the next mode.
+	leds_set_mode(settings.led_mode);
+	settings_changed();
+}
 
-	leds_set_mode(led_mode);
+// Keep the pwm frequency whilst the cpu clock is divided by 8 (slow = true, see governor.h) or back at full speed.  Timer1 is
+// clocked from clk_I/O, which the system clock prescaler divides by 8 along with the cpu, and the timer has no prescaler of its own
+// left to take off (it is already at clk/1).  So instead the count is shortened by LEDS_SLOW_SHIFT bits (TOP / 8, and the duty cycle
+// with it), which keeps the pwm at 3.9kHz.
+void leds_slow_clock(bool slow)
+{
+	pwm_shift = (slow ? LEDS_SLOW_SHIFT : 0);
+	PWM_TOP = (LEDS_PWM_MAX >> pwm_shift);
+	PWM_COUNT = 0;
+	PWM_SET = (shown >> pwm_shift);
 }
 
 // Enable pr disable the mode button.
@@ -117,6 +347,32 @@ void leds_button_enable(bool enable)
 	else		BUTTON_PCICR &= ~(1 << BUTTON_PCIE);	// Disable the button pin-change interrupt.
 }
 
+// The mode button pin has changed (pressed, released or a bounce).  Called from the pin-change interrupt.
+void leds_button_changed(void)
+{
+	button_changed = true;
+}
+
+// De-bounce the mode button, and step to the next led mode each time it goes down.  Called every pass of the main loop.
+void leds_button_task(void)
+{
+	uint16_t now = systick_ms();
+
+	// Every change of the pin starts the de-bounce time again.
+	if(button_changed)
+	{
+		button_changed = false;
+		button_change_ms = now;
+		return;
+	}
+	if((uint16_t)(now - button_change_ms) < BUTTON_DEBOUNCE_MS) return;
+
+	// The pin has settled - act on the button going down.
+	if(leds_button_state() == button_down) return;
+	button_down = !button_down;
+	if(button_down) leds_change_mode();
+}
+
 // Check the state of the pin.  Returns true if pressed.
 bool leds_button_state(void)
 {
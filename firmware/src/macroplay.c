@@ -0,0 +1,267 @@
+// Macro player - see macroplay.h.
+
+#include "macroplay.h"
+#include "settings.h"
+#include "leds.h"
+
+// State of a macro slot.
+typedef struct
+{
+	const macro_t *next;	// Next byte of the macro, or null if the slot is free.
+	uint8_t action;		// Action being played, or M_NULL between actions.
+	uint8_t remaining;	// Characters or keys left to type.
+	bool pressed;		// The last report typed by this slot has keys down (the next one releases them).
+	uint8_t frames;		// Frames left before the slot may send its next report.
+	uint16_t since;		// When the keys went down or were last released, or the wait started (M_WAIT).
+	uint16_t wait_ms;	// Length of the wait.
+	macro_pace_t pace;	// Pace of this macro.
+	zstring_t text;		// Decoder for M_ZSTRING.
+} macro_slot_t;
+
+// The slots, the slot holding the keyboard report (if any) and the slot to be given the first turn of the next frame.
+static macro_slot_t slots[MACRO_SLOTS];
+#define NO_SLOT		0xFF
+static uint8_t owner = NO_SLOT;
+static uint8_t first_turn = 0;
+
+// The keyboard report typed by the owner, and whether it is still waiting to be sent.
+static uint8_t report_modifier;
+static uint8_t report_keys[MAX_KEYS];
+static bool report_pending = false;
+
+// Set by the start of frame interrupt.
+static volatile bool frame_started = false;
+
+// Start with every slot free.
+void macroplay_init(void)
+{
+	memset(slots, 0, sizeof(slots));
+	owner = NO_SLOT;
+	report_pending = false;
+}
+
+// Returns true if any slot is playing a macro.
+bool macroplay_busy(void)
+{
+	for(uint8_t s = 0; s < MACRO_SLOTS; s++) if(slots[s].next) return(true);
+	return(false);
+}
+
+// Start playing a macro in a free slot.  Returns false (and the macro is not played) if every slot is busy.
+bool macroplay_start(const macro_t *macro)
+{
+	if(!macro) return(false);
+
+	for(uint8_t s = 0; s < MACRO_SLOTS; s++)
+	{
+		if(slots[s].next) continue;
+
+		memset(&slots[s], 0, sizeof(macro_slot_t));
+		slots[s].next = macro;
+		slots[s].pace = settings.macro_pace;
+		slots[s].since = (systick_ms() - slots[s].pace.gap_ms);
+		leds_macro(true);
+		return(true);
+	}
+
+	return(false);
+}
+
+// A USB frame has started.  Called from the start of frame event (interrupt).
+void macroplay_frame(void)
+{
+	frame_started = true;
+}
+
+// Write the next report of a typing action to report_keys and report_modifier.  Returns false once the action is finished.
+static bool type_next(macro_slot_t *slot, uint16_t now)
+{
+	char c = 0;
+
+	// Every report with keys down is followed by one releasing them - after DEBOUNCE_MS for a combination of keys, as otherwise
+	// the host may take it for a bounce.
+	if(slot->pressed)
+	{
+		if((slot->action == M_KEYS) && ((uint16_t)(now - slot->since) < DEBOUNCE_MS)) return(true);
+
+		memset(report_keys, 0, sizeof(report_keys));
+		report_modifier = 0;
+		slot->pressed = false;
+		slot->since = now;
+		report_pending = true;
+		return(true);
+	}
+
+	// Then the gap of the pace before the next character or keys go down.
+	if((uint16_t)(now - slot->since) < slot->pace.gap_ms) return(true);
+
+	memset(report_keys, 0, sizeof(report_keys));
+	report_modifier = 0;
+
+	switch(slot->action)
+	{
+		// The next character of a string.
+		case M_STRING:
+			if(!slot->remaining) return(false);
+			c = pgm_read_byte(slot->next++);
+			slot->remaining--;
+			break;
+
+		// The next character of compressed text.
+		case M_ZSTRING:
+			if(!(c = zstring_next(&slot->text))) return(false);
+			break;
+
+		// All of the keys at once.
+		case M_KEYS:
+			if(!slot->remaining) return(false);
+			for(uint8_t i = 0; slot->remaining; slot->remaining--)
+			{
+				uint8_t key = pgm_read_byte(slot->next++);
+
+				// Regular keys go in the key array (as many as fit), modifiers are set in the modifier byte.
+				if(key <= HID_KEYBOARD_SC_APPLICATION)
+				{
+					if(i < MAX_KEYS) report_keys[i++] = key;
+				}
+				else if((key >= HID_KEYBOARD_SC_LEFT_CONTROL) && (key <= HID_KEYBOARD_SC_RIGHT_GUI))
+				{
+					report_modifier |= (1 << (key - HID_KEYBOARD_SC_LEFT_CONTROL));
+				}
+			}
+			slot->since = now;
+			break;
+	}
+
+	// A character is typed as its key, shifted if need be.
+	if(c)
+	{
+		report_keys[0] = char_to_code(c);
+		report_modifier = (upper_case_check(c) << 1);
+	}
+
+	slot->pressed = true;
+	report_pending = true;
+	return(true);
+}
+
+// Give a slot its turn - play its macro as far as it can go this frame.
+static void slot_turn(uint8_t s, uint16_t now)
+{
+	macro_slot_t *slot = &slots[s];
+
+	// Count down the frames of the pace.
+	if(slot->frames) slot->frames--;
+
+	while(slot->next)
+	{
+		switch(slot->action)
+		{
+			// Between actions.  The owner first waits for its last report to be sent.
+			case M_NULL: ;
+				if((owner == s) && report_pending) return;
+
+				uint8_t action = pgm_read_byte(slot->next++);
+				uint8_t arg = (action ? pgm_read_byte(slot->next++) : 0);
+
+				slot->action = action;
+				slot->remaining = arg;
+				slot->pressed = false;
+
+				switch(action)
+				{
+					case M_STRING:
+					case M_KEYS:
+						break;
+
+					case M_ZSTRING:
+						zstring_open(&slot->text, arg);
+						break;
+
+					// A wait hands the keyboard report back.
+					case M_WAIT:
+						slot->wait_ms = (arg | ((uint16_t)pgm_read_byte(slot->next++) << 8));
+						slot->since = now;
+						if(owner == s) owner = NO_SLOT;
+						break;
+
+					// A new pace takes effect straight away.
+					case M_PACE:
+						slot->pace.frames = (arg ? arg : 1);
+						slot->pace.gap_ms = pgm_read_byte(slot->next++);
+						slot->action = M_NULL;
+						break;
+
+					// The end of the macro (or something this firmware does not understand) frees the slot.
+					default:
+						slot->next = 0;
+						if(owner == s) owner = NO_SLOT;
+						if(!macroplay_busy()) leds_macro(false);
+						return;
+				}
+				break;
+
+			// Wait until the time is up.
+			case M_WAIT:
+				if((uint16_t)(now - slot->since) < slot->wait_ms) return;
+				slot->action = M_NULL;
+				break;
+
+			// A typing action needs the keyboard report, and types at most one report every pace.frames frames.
+			default:
+				if(owner != s)
+				{
+					if(owner != NO_SLOT) return;
+					owner = s;
+				}
+				if(report_pending || slot->frames) return;
+				if(type_next(slot, now))
+				{
+					if(report_pending) slot->frames = slot->pace.frames;
+					return;
+				}
+				slot->action = M_NULL;
+				break;
+		}
+	}
+}
+
+// Give each busy slot its turn.  Called every pass of the main loop, but does nothing until the next USB frame.
+void macroplay_task(void)
+{
+	if(!frame_started) return;
+	frame_started = false;
+
+	uint16_t now = systick_ms();
+
+	for(uint8_t i = 0; i < MACRO_SLOTS; i++) slot_turn((first_turn + i) % MACRO_SLOTS, now);
+	first_turn = (first_turn + 1) % MACRO_SLOTS;
+}
+
+// Returns true if a macro has the keyboard report.
+bool macroplay_typing(void)
+{
+	return(owner != NO_SLOT);
+}
+
+// Returns true if the macro report has changed since it was last sent.
+bool macroplay_report_pending(void)
+{
+	return(report_pending);
+}
+
+// If a macro has the keyboard report, write its keys and modifiers to the given report and return true.
+bool macroplay_fill_report(uint8_t *modifier, uint8_t keys[MAX_KEYS])
+{
+	if(owner == NO_SLOT) return(false);
+
+	*modifier = report_modifier;
+	memcpy(keys, report_keys, sizeof(report_keys));
+	return(true);
+}
+
+// The report written by macroplay_fill_report() has been handed to the host.
+void macroplay_report_sent(void)
+{
+	report_pending = false;
+}
@@ -0,0 +1,259 @@
+// Macro store in application flash - see macrostore.h.
+
+#include "macrostore.h"
+#include "macroplay.h"
+
+// The bank being played from (or MACROSTORE_NONE).
+static uint8_t active_bank = MACROSTORE_NONE;
+
+// Transfer in progress: the bank being written, the image length announced by the host, how much has arrived and the page being
+// filled.
+static uint8_t write_bank = MACROSTORE_NONE;
+static uint16_t write_length;
+static uint16_t write_offset;
+static uint8_t page_buffer[SPM_PAGESIZE];
+
+// The page waiting for macrostore_task(): where it goes and the next step (erase, then write).  Once the page is full it is handed
+// over, and the buffer is not touched again until the page has been written.  committing is set whilst the page is the header of
+// the new image, so the bank is switched to once it is in.
+#define PAGE_IDLE	0
+#define PAGE_ERASE	1
+#define PAGE_WRITE	2
+static uint8_t page_step = PAGE_IDLE;
+static uint16_t page_address;
+static bool committing = false;
+
+// The end of a piece that ran on past a full page, waiting for the buffer to be free (it starts the next page).
+static uint8_t carry[MACROSTORE_PIECE_MAX];
+static uint8_t carry_count = 0;
+
+// Flash address of a bank.
+static inline uint16_t bank_address(uint8_t bank)
+{
+	return(MACROSTORE_START + ((uint16_t)bank * MACROSTORE_BANK_SIZE));
+}
+
+// Flash address of the macro image of a bank.
+static inline uint16_t image_address(uint8_t bank)
+{
+	return(bank_address(bank) + SPM_PAGESIZE);
+}
+
+// Returns the header of a bank (in flash).
+const macrostore_header_t *macrostore_header(uint8_t bank)
+{
+	return((const macrostore_header_t *)bank_address(bank));
+}
+
+// Returns true if a bank holds a complete image that matches its checksum.
+static bool bank_valid(uint8_t bank)
+{
+	const macrostore_header_t *header = macrostore_header(bank);
+	uint16_t length = pgm_read_word(&header->length);
+	uint16_t crc = 0xFFFF;
+
+	if(pgm_read_word(&header->magic) != MACROSTORE_MAGIC) return(false);
+	if(length > MACROSTORE_DATA_SIZE) return(false);
+
+	for(uint16_t i = 0; i < length; i++) crc = _crc16_update(crc, pgm_read_byte(image_address(bank) + i));
+
+	return(crc == pgm_read_word(&header->crc));
+}
+
+// Pick the bank to play from: the valid bank with the later sequence number.
+void macrostore_init(void)
+{
+	bool valid0 = bank_valid(0);
+	bool valid1 = bank_valid(1);
+
+	if(valid0 && valid1)
+	{
+		int16_t age = (pgm_read_word(&macrostore_header(1)->sequence) - pgm_read_word(&macrostore_header(0)->sequence));
+		active_bank = ((age > 0) ? 1 : 0);
+	}
+	else if(valid0)	active_bank = 0;
+	else if(valid1)	active_bank = 1;
+	else		active_bank = MACROSTORE_NONE;
+
+	write_bank = MACROSTORE_NONE;
+	page_step = PAGE_IDLE;
+	committing = false;
+	carry_count = 0;
+}
+
+// Returns the bank being played from.
+uint8_t macrostore_bank(void)
+{
+	return(active_bank);
+}
+
+// Returns stored macro n (a flash address, as for the compiled-in macros), or 0 if there is no such macro.
+const macro_t *macrostore_macro(uint8_t n)
+{
+	if(active_bank == MACROSTORE_NONE) return(0);
+
+	const macrostore_image_t *image = (const macrostore_image_t *)image_address(active_bank);
+	if(n >= pgm_read_byte(&image->count)) return(0);
+
+	uint16_t offset = pgm_read_word(&image->offsets[n]);
+	if(offset >= pgm_read_word(&macrostore_header(active_bank)->length)) return(0);
+
+	return((const macro_t *)(image_address(active_bank) + offset));
+}
+
+// Erase one flash page.  Runs from the boot section with interrupts off, since the vector table and the rest of the application
+// cannot be read whilst the application section is being written.  Takes roughly 4ms.
+void macrostore_erase_page(uint16_t address)
+{
+	uint8_t sreg = SREG;
+	cli();
+
+	eeprom_busy_wait();
+
+	boot_page_erase(address);
+	boot_spm_busy_wait();
+
+	// Make the application section readable again.
+	boot_rww_enable();
+
+	SREG = sreg;
+}
+
+// Write one (erased) flash page, as macrostore_erase_page().  Takes roughly 4ms.
+void macrostore_write_page(uint16_t address, const uint8_t *data)
+{
+	uint8_t sreg = SREG;
+	cli();
+
+	eeprom_busy_wait();
+
+	for(uint8_t i = 0; i < SPM_PAGESIZE; i += 2) boot_page_fill(address + i, (data[i] | (data[i + 1] << 8)));
+
+	boot_page_write(address);
+	boot_spm_busy_wait();
+
+	// Make the application section readable again.
+	boot_rww_enable();
+
+	SREG = sreg;
+}
+
+// Hand the page buffer over to be written to the given address.
+static void page_queue(uint16_t address)
+{
+	page_address = address;
+	page_step = PAGE_ERASE;
+}
+
+// Erase or write the waiting page, one step per pass, so the system tick, usb and scanning run between the steps (and never inside
+// a usb request).  Called every pass of the main loop.
+void macrostore_task(void)
+{
+	// Wait for the EEPROM here rather than with interrupts off.
+	if((page_step == PAGE_IDLE) || !eeprom_is_ready()) return;
+
+	if(page_step == PAGE_ERASE)
+	{
+		macrostore_erase_page(page_address);
+		page_step = PAGE_WRITE;
+		return;
+	}
+
+	macrostore_write_page(page_address, page_buffer);
+	memset(page_buffer, 0xFF, sizeof(page_buffer));
+	page_step = PAGE_IDLE;
+
+	// Start the next page with the end of the last piece, which may be the end of the image.
+	if(carry_count)
+	{
+		memcpy(page_buffer, carry, carry_count);
+		carry_count = 0;
+		if(write_offset == write_length) page_queue(image_address(write_bank) + ((write_offset - 1) & ~(SPM_PAGESIZE - 1)));
+	}
+
+	// The header is in - switch to the new bank.
+	if(committing)
+	{
+		active_bank = write_bank;
+		write_bank = MACROSTORE_NONE;
+		committing = false;
+	}
+}
+
+// Start writing a new image of the given length into the bank not in use.  Its header is erased first so that the bank is not
+// used until the new image is committed.  Busy whilst a page is still being written, or whilst a macro is playing (it may be
+// playing from that bank, if it started before the last commit).
+uint8_t macrostore_begin(uint16_t length)
+{
+	if(length > MACROSTORE_DATA_SIZE) return(MACROSTORE_BAD_ARG);
+	if((page_step != PAGE_IDLE) || macroplay_busy()) return(MACROSTORE_BUSY);
+
+	write_bank = ((active_bank == 0) ? 1 : 0);
+	write_length = length;
+	write_offset = 0;
+	carry_count = 0;
+
+	memset(page_buffer, 0xFF, sizeof(page_buffer));
+	page_queue(bank_address(write_bank));
+
+	return(MACROSTORE_OK);
+}
+
+// Add the next piece of the image.  Pieces must arrive in order.  Each page is written (by macrostore_task()) once it is full, and the
+// last part-page once the whole image has arrived.  Busy whilst the last page is still being written.
+uint8_t macrostore_data(uint16_t offset, const uint8_t *data, uint8_t count)
+{
+	if((write_bank == MACROSTORE_NONE) || committing || (offset != write_offset) || ((uint32_t)offset + count > write_length) ||
+	   (count > MACROSTORE_PIECE_MAX))
+		return(MACROSTORE_BAD_ARG);
+	if(page_step != PAGE_IDLE) return(MACROSTORE_BUSY);
+
+	while(count)
+	{
+		page_buffer[write_offset % SPM_PAGESIZE] = *data++;
+		write_offset++;
+		count--;
+
+		if(!(write_offset % SPM_PAGESIZE) || (write_offset == write_length))
+		{
+			page_queue(image_address(write_bank) + ((write_offset - 1) & ~(SPM_PAGESIZE - 1)));
+			break;
+		}
+	}
+
+	// Whatever is left of the piece starts the next page, once the buffer is free.
+	memcpy(carry, data, count);
+	carry_count = count;
+	write_offset += count;
+
+	return(MACROSTORE_OK);
+}
+
+// Finish the image: once every page is written, check the image against the host's checksum, then queue the header.  The new bank is
+// switched to once the header is in.
+uint8_t macrostore_commit(uint16_t crc)
+{
+	if((write_bank == MACROSTORE_NONE) || committing || (write_offset != write_length)) return(MACROSTORE_BAD_ARG);
+	if((page_step != PAGE_IDLE) || carry_count) return(MACROSTORE_BUSY);
+
+	// Check what was actually written.
+	uint16_t check = 0xFFFF;
+	for(uint16_t i = 0; i < write_length; i++) check = _crc16_update(check, pgm_read_byte(image_address(write_bank) + i));
+	if(check != crc)
+	{
+		write_bank = MACROSTORE_NONE;
+		return(MACROSTORE_BAD_CRC);
+	}
+
+	// Commit.
+	macrostore_header_t *header = (macrostore_header_t *)page_buffer;
+	memset(page_buffer, 0xFF, sizeof(page_buffer));
+	header->magic = MACROSTORE_MAGIC;
+	header->sequence = ((active_bank == MACROSTORE_NONE) ? 0 : (pgm_read_word(&macrostore_header(active_bank)->sequence) + 1));
+	header->length = write_length;
+	header->crc = crc;
+	page_queue(bank_address(write_bank));
+	committing = true;
+
+	return(MACROSTORE_OK);
+}
@@ -0,0 +1,126 @@
+// Mouse keys - see mousekey.h.
+
+#include "mousekey.h"
+#include "settings.h"
+
+#define MOVE_KEYS	((1 << MOUSEKEY_UP) | (1 << MOUSEKEY_DOWN) | (1 << MOUSEKEY_LEFT) | (1 << MOUSEKEY_RIGHT))
+#define WHEEL_KEYS	((1 << MOUSEKEY_WHEEL_UP) | (1 << MOUSEKEY_WHEEL_DOWN))
+#define BUTTON_KEYS	((1 << MOUSEKEY_BUTTON1) | (1 << MOUSEKEY_BUTTON2) | (1 << MOUSEKEY_BUTTON3))
+
+// The mouse keys held (a bit for each), and whether the buttons have changed since the last report.
+static volatile uint16_t held = 0;
+static volatile bool buttons_changed = false;
+
+// The motion not yet reported, in whole pixels and wheel steps.
+static volatile int8_t motion_x = 0;
+static volatile int8_t motion_y = 0;
+static volatile int8_t motion_wheel = 0;
+
+// The speed of the pointer and the part of a pixel it has moved on each axis, both in 1/65536 pixel (per millisecond), and the
+// milliseconds to the next wheel step.  Only touched by the system tick interrupt.
+static uint32_t speed = 0;
+static int32_t fraction_x = 0;
+static int32_t fraction_y = 0;
+static uint8_t wheel_ms = 0;
+
+// A mouse key went down (pressed = true) or up.  Called by handle_key() with the argument of an MS_* keycode.
+void mousekey_key(uint8_t key, bool pressed)
+{
+	if(key >= MOUSEKEY_KEYS) return;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(pressed)	held |= (1 << key);
+		else		held &= ~(1 << key);
+		if((1 << key) & BUTTON_KEYS) buttons_changed = true;
+	}
+}
+
+// Add a millisecond of motion along one axis (direction -1, 0 or 1) to the motion not yet reported.
+static void move(int32_t *fraction, volatile int8_t *motion, int8_t direction)
+{
+	int32_t pixels;
+	int16_t total;
+
+	*fraction += (direction * (int32_t)speed);
+	pixels = (*fraction >> 16);
+	if(!pixels) return;
+	*fraction -= (pixels * 65536);
+
+	// A host that is not taking reports gets at most one report's worth.
+	total = (*motion + pixels);
+	if(total > 127)		total = 127;
+	else if(total < -127)	total = -127;
+	*motion = total;
+}
+
+// Move the pointer and wheel on by a millisecond.  Called from the system tick interrupt.
+void mousekey_tick(void)
+{
+	uint16_t keys = held;
+
+	// Turn the wheel a step straight away, then every MOUSEKEY_WHEEL_MS.
+	if(keys & WHEEL_KEYS)
+	{
+		if(!wheel_ms)
+		{
+			if((keys & (1 << MOUSEKEY_WHEEL_UP)) && (motion_wheel < 127))		motion_wheel++;
+			if((keys & (1 << MOUSEKEY_WHEEL_DOWN)) && (motion_wheel > -127))	motion_wheel--;
+			wheel_ms = MOUSEKEY_WHEEL_MS;
+		}
+		wheel_ms--;
+	}
+	else wheel_ms = 0;
+
+	// The pointer stops (and starts again from the start speed) once every direction key is up.
+	if(!(keys & MOVE_KEYS))
+	{
+		speed = 0;
+		fraction_x = 0;
+		fraction_y = 0;
+		return;
+	}
+
+	// Speed up along the curve, to the top speed.
+	const mousekey_profile_t *profile = &settings.mouse;
+	uint32_t top = ((uint32_t)profile->max << 8);
+
+	if(!speed)					speed = ((uint32_t)profile->start << 8);
+	else if(profile->curve == MOUSEKEY_LINEAR)	speed += profile->accel;
+	else if(profile->curve == MOUSEKEY_EXPONENTIAL)	speed += (((speed >> 8) * profile->accel) >> 8);
+	if(profile->curve == MOUSEKEY_CONSTANT) speed = top;
+	if(speed > top) speed = top;
+
+	// Move along each axis (y is down the screen).
+	move(&fraction_x, &motion_x, (!!(keys & (1 << MOUSEKEY_RIGHT)) - !!(keys & (1 << MOUSEKEY_LEFT))));
+	move(&fraction_y, &motion_y, (!!(keys & (1 << MOUSEKEY_DOWN)) - !!(keys & (1 << MOUSEKEY_UP))));
+}
+
+// Take the buttons held and the motion since the last report.  Returns true if there is motion or the buttons have changed (i.e.
+// if a report should be sent).
+bool mousekey_take(uint8_t *buttons, int8_t *x, int8_t *y, int8_t *wheel)
+{
+	bool send;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*buttons = ((held & BUTTON_KEYS) >> MOUSEKEY_BUTTON1);
+		*x = motion_x;
+		*y = motion_y;
+		*wheel = motion_wheel;
+		send = (buttons_changed || motion_x || motion_y || motion_wheel);
+
+		motion_x = 0;
+		motion_y = 0;
+		motion_wheel = 0;
+		buttons_changed = false;
+	}
+
+	return(send);
+}
+
+// Returns true if a profile can be used.
+bool mousekey_profile_valid(const mousekey_profile_t *profile)
+{
+	return((profile->curve < MOUSEKEY_CURVES) && profile->start && (profile->start <= profile->max) && (profile->max <= 0x7FFF));
+}
@@ -0,0 +1,73 @@
+// Cycle profiler - see profile.h.
+
+#include "profile.h"
+
+#ifdef PROFILE
+
+// Names of the probes, in probe order.
+static const char names[PROFILE_NUM_PROBES][PROFILE_NAME_MAX + 1] PROGMEM =
+{
+	"hid_task",
+	"scan",
+	"handle_key",
+	"kbd_create",
+	"kbd_send",
+	"media_send",
+	"leds_receive",
+	"systick_isr",
+	"mouse_send",
+};
+
+// The counters of every probe.
+static profile_probe_t probes[PROFILE_NUM_PROBES];
+
+// Add a run of the given length to the counters of a probe.  Atomic, as the system tick interrupt probe can end in the middle of a
+// main loop probe being recorded.
+static void record(uint8_t probe, uint32_t cycles)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		profile_probe_t *p = &probes[probe];
+		p->calls++;
+		p->cycles += cycles;
+		if(cycles > p->max_cycles) p->max_cycles = cycles;
+	}
+}
+
+// A probe has gone out of scope.  Called by the cleanup of PROFILE_PROBE().
+void profile_leave(profile_scope_t *scope)
+{
+	uint32_t now = systick_cycles();
+
+	if(now < scope->start) now += SYSTICK_CYCLES_WRAP;
+	record(scope->probe, (now - scope->start));
+}
+
+// An interrupt probe has gone out of scope.  Called by the cleanup of PROFILE_ISR_PROBE().
+void profile_leave_isr(profile_scope_t *scope)
+{
+	uint16_t count = SYSTICK_COUNT;
+
+	if(count < scope->start) count += (SYSTICK_TOP + 1);
+	record(scope->probe, ((uint32_t)(count - scope->start) * SYSTICK_PRESCALER));
+}
+
+// Copy the counters of a probe.
+void profile_read(uint8_t probe, profile_probe_t *counters)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) *counters = probes[probe];
+}
+
+// Returns the name of a probe (in flash).
+const char *profile_name(uint8_t probe)
+{
+	return(names[probe]);
+}
+
+// Clear every counter.
+void profile_reset(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) memset(probes, 0, sizeof(probes));
+}
+
+#endif
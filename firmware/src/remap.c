@@ -0,0 +1,205 @@
+// Runtime keymap overrides - see remap.h.
+
+#include "remap.h"
+
+// The override table in EEPROM.
+static uint16_t EEMEM ee_remap_magic;
+static uint8_t EEMEM ee_remap_count;
+static remap_entry_t EEMEM ee_remap[REMAP_MAX_OVERRIDES];
+
+// A queued override and the slot of the table it goes in.
+typedef struct
+{
+	uint8_t slot;
+	remap_entry_t entry;
+} remap_write_t;
+
+// Whether the table is initialised, the entries it counts, and the slots used once the queue is written.
+static bool stored_valid = false;
+static uint8_t stored = 0;
+static uint8_t slots = 0;
+
+// Set whilst the table is to be emptied (before anything in the queue is written).
+static bool clearing = false;
+
+// The queue (head first), and the next byte to write of the head (or of the clear).
+static remap_write_t queue[REMAP_QUEUE];
+static uint8_t queue_head = 0;
+static uint8_t queue_count = 0;
+static uint8_t write_step = 0;
+
+// Returns the number of overrides, counting those still to be written.
+uint8_t remap_count(void)
+{
+	return(slots);
+}
+
+// Copy the compiled-in keymap into RAM.
+static void remap_load_keymap(void)
+{
+	memcpy_P(keymap_ram, KEYMAPS, (uint16_t)keymap_num_layers * MATRIX_KEYS * sizeof(keycode_t));
+}
+
+// Load the keymap into RAM: the compiled-in keymap with the stored overrides on top.
+void remap_init(void)
+{
+	stored_valid = (eeprom_read_word(&ee_remap_magic) == REMAP_MAGIC);
+	stored = (stored_valid ? eeprom_read_byte(&ee_remap_count) : 0);
+	if(stored > REMAP_MAX_OVERRIDES) stored = 0;
+	slots = stored;
+
+	remap_load_keymap();
+
+	for(uint8_t i = 0; i < stored; i++)
+	{
+		remap_entry_t entry;
+		eeprom_read_block(&entry, &ee_remap[i], sizeof(remap_entry_t));
+
+		// Skip overrides left over from a keymap with more layers or keys, and any cut short whilst being changed.
+		if((entry.layer < keymap_num_layers) && (entry.key < MATRIX_KEYS))
+			keymap_ram[((uint16_t)entry.layer * MATRIX_KEYS) + entry.key] = entry.keycode;
+	}
+}
+
+// Returns the slot of the table holding (or queued to hold) the override of a key on a layer, or REMAP_MAX_OVERRIDES if none.
+static uint8_t remap_find(uint8_t layer, uint8_t key)
+{
+	// The queue first, as an entry being changed is not marked with its key until it is written.
+	for(uint8_t i = 0; i < queue_count; i++)
+	{
+		remap_write_t *write = &queue[(queue_head + i) % REMAP_QUEUE];
+		if((write->entry.layer == layer) && (write->entry.key == key)) return(write->slot);
+	}
+
+	// Whilst the table is being emptied its entries are already gone.
+	if(clearing) return(REMAP_MAX_OVERRIDES);
+
+	for(uint8_t i = 0; i < stored; i++)
+	{
+		if((eeprom_read_byte(&ee_remap[i].layer) == layer) && (eeprom_read_byte(&ee_remap[i].key) == key)) return(i);
+	}
+
+	return(REMAP_MAX_OVERRIDES);
+}
+
+// Override a key on a layer, in RAM straight away and queued for EEPROM for the next boot.
+uint8_t remap_set(uint8_t layer, uint8_t key, keycode_t keycode)
+{
+	if((layer >= keymap_num_layers) || (key >= MATRIX_KEYS)) return(REMAP_BAD_ARG);
+
+	uint8_t slot = remap_find(layer, key);
+
+	// A queued write of the same slot that has not been started just takes the new keycode.
+	for(uint8_t i = (write_step ? 1 : 0); i < queue_count; i++)
+	{
+		remap_write_t *write = &queue[(queue_head + i) % REMAP_QUEUE];
+		if(write->slot != slot) continue;
+
+		write->entry.keycode = keycode;
+		keymap_ram[((uint16_t)layer * MATRIX_KEYS) + key] = keycode;
+		return(REMAP_OK);
+	}
+
+	if(queue_count == REMAP_QUEUE) return(REMAP_BUSY);
+	if(slot == REMAP_MAX_OVERRIDES)
+	{
+		if(slots == REMAP_MAX_OVERRIDES) return(REMAP_FULL);
+		slot = slots++;
+	}
+
+	remap_write_t *write = &queue[(queue_head + queue_count++) % REMAP_QUEUE];
+	write->slot = slot;
+	write->entry = (remap_entry_t){layer, key, keycode};
+
+	keymap_ram[((uint16_t)layer * MATRIX_KEYS) + key] = keycode;
+	return(REMAP_OK);
+}
+
+// Remove every override and go back to the compiled-in keymap.  Anything still queued is dropped, and the table is emptied in the
+// background.
+void remap_reset(void)
+{
+	queue_count = 0;
+	write_step = 0;
+	stored = 0;
+	slots = 0;
+	clearing = true;
+
+	remap_load_keymap();
+}
+
+// Write the next byte of the table.  Called every pass of the main loop.
+void remap_task(void)
+{
+	uint8_t *address;
+	uint8_t value;
+
+	if(!eeprom_is_ready()) return;
+
+	// Empty (or initialise) the table before adding to it.  The count is zeroed before the magic is written, so a good magic never
+	// comes with a stale count.
+	if(clearing || (queue_count && !stored_valid))
+	{
+		clearing = true;
+		switch(write_step)
+		{
+			case 0:		address = &ee_remap_count;			value = 0;			break;
+			case 1:		address = (uint8_t *)&ee_remap_magic;		value = (REMAP_MAGIC & 0xFF);	break;
+			default:	address = ((uint8_t *)&ee_remap_magic) + 1;	value = (REMAP_MAGIC >> 8);	break;
+		}
+		eeprom_update_byte(address, value);
+
+		if(++write_step == 3)
+		{
+			stored_valid = true;
+			stored = 0;
+			clearing = false;
+			write_step = 0;
+		}
+		return;
+	}
+
+	if(!queue_count) return;
+
+	remap_write_t *write = &queue[queue_head];
+	remap_entry_t *entry = &ee_remap[write->slot];
+	const uint8_t *keycode = (const uint8_t *)&write->entry.keycode;
+	uint8_t steps;
+
+	if(write->slot < stored)
+	{
+		// Changing an entry: unmark it once the new keycode is in.
+		steps = 4;
+		switch(write_step)
+		{
+			case 0:		address = &entry->key;				value = REMAP_NO_KEY;		break;
+			case 1:		address = (uint8_t *)&entry->keycode;		value = keycode[0];		break;
+			case 2:		address = ((uint8_t *)&entry->keycode) + 1;	value = keycode[1];		break;
+			default:	address = &entry->key;				value = write->entry.key;	break;
+		}
+	}
+	else
+	{
+		// Adding an entry (always the next slot): count it once all of it is in.
+		steps = (sizeof(remap_entry_t) + 1);
+		if(write_step < sizeof(remap_entry_t))
+		{
+			address = ((uint8_t *)entry) + write_step;
+			value = ((const uint8_t *)&write->entry)[write_step];
+		}
+		else
+		{
+			address = &ee_remap_count;
+			value = (write->slot + 1);
+		}
+	}
+	eeprom_update_byte(address, value);
+
+	if(++write_step == steps)
+	{
+		if(write->slot == stored) stored++;
+		queue_head = ((queue_head + 1) % REMAP_QUEUE);
+		queue_count--;
+		write_step = 0;
+	}
+}
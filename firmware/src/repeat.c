@@ -0,0 +1,129 @@
+// Typematic auto-repeat - see repeat.h.
+
+#include "repeat.h"
+#include "events.h"
+#include "macroplay.h"
+#include "settings.h"
+
+// States of the repeating key.
+#define STATE_IDLE	0	// No key is repeating.
+#define STATE_HELD	1	// The key is down until the next repeat is due.
+#define STATE_RELEASED	2	// The key has been released for a repeat, and goes down again once that has reached the host.
+
+// The repeating key, its role and class, when it last went down or up for a repeat, the wait from then to the next repeat, and the
+// interval after that.
+static uint8_t state = STATE_IDLE;
+static uint8_t repeat_key;
+static uint8_t repeat_role;
+static uint8_t repeat_class;
+static uint16_t since;
+static uint16_t wait_ms;
+static uint8_t interval_ms;
+
+// A key that a newer key took over from whilst it was released for a repeat, so is still to go back down.
+static bool restore = false;
+static uint8_t restore_key;
+static uint8_t restore_role;
+
+// Returns the class of a keycode, or REPEAT_NONE if it does not repeat.
+static uint8_t keycode_class(keycode_t keycode)
+{
+	if(KC_KIND(keycode) == KC_SMACRO)						return(REPEAT_MACROS);
+	if((keycode >= HID_KEYBOARD_SC_MACRO_FIRST) && (keycode <= HID_KEYBOARD_SC_MACRO_LAST))	return(REPEAT_MACROS);
+	if(KC_IS_CONSUMER(keycode))							return(REPEAT_CONSUMER);
+	if((keycode >= HID_KEYBOARD_SC_A) && (keycode <= HID_KEYBOARD_SC_APPLICATION))	return(REPEAT_KEYS);
+	return(REPEAT_NONE);
+}
+
+// Returns true once the last release or press has reached the host.  Consumer keys go in the media controller report, which is
+// polled less often than the keyboard report, so a consumer release must not be pressed again before that report has gone too.
+static bool repeat_sent(void)
+{
+	return(events_idle() && !keyscan_report.consumer_changed);
+}
+
+// Start with nothing repeating.
+void repeat_init(void)
+{
+	state = STATE_IDLE;
+	restore = false;
+}
+
+// A key has been registered as pressed (with the keycode it resolved to).  Called by the key event pipeline.
+void repeat_pressed(uint8_t key, keycode_t keycode, uint8_t role)
+{
+	uint8_t class = keycode_class(keycode);
+
+	// Keys that do not repeat leave the repeating key be, and the repeating key going down again is its own repeat.
+	if(class == REPEAT_NONE) return;
+	if((state != STATE_IDLE) && (key == repeat_key)) return;
+
+	const repeat_profile_t *profile = &settings.repeat[class];
+
+	// The newest key takes over.  If the last one is up for a repeat, it goes back down.
+	if(state == STATE_RELEASED)
+	{
+		restore = true;
+		restore_key = repeat_key;
+		restore_role = repeat_role;
+	}
+
+	state = (profile->delay_ms ? STATE_HELD : STATE_IDLE);
+	repeat_key = key;
+	repeat_role = role;
+	repeat_class = class;
+	since = systick_ms();
+	wait_ms = profile->delay_ms;
+	interval_ms = profile->interval_ms;
+}
+
+// A key has gone up.  Called with each release as it leaves the key event pipeline (but not those made here).
+void repeat_released(uint8_t key)
+{
+	if(restore && (key == restore_key)) restore = false;
+	if((state != STATE_IDLE) && (key == repeat_key)) state = STATE_IDLE;
+}
+
+// Release the repeating key when a repeat is due, and press it again once the release has reached the host.  Called every pass of
+// the main loop.
+void repeat_task(uint16_t now)
+{
+	// Put back a key that was taken over whilst it was up.
+	if(restore)
+	{
+		if(!repeat_sent()) return;
+		events_repeat(restore_key, true, restore_role);
+		restore = false;
+	}
+
+	switch(state)
+	{
+		case STATE_HELD:
+			// A macro key repeats once its last macro has finished playing.
+			if((uint16_t)(now - since) < wait_ms) return;
+			if((repeat_class == REPEAT_MACROS) && macroplay_busy()) return;
+
+			events_repeat(repeat_key, false, repeat_role);
+			state = STATE_RELEASED;
+			since = now;
+			wait_ms = interval_ms;
+
+			// Speed up for the next repeat.
+			const repeat_profile_t *profile = &settings.repeat[repeat_class];
+			if(interval_ms > (profile->min_interval_ms + profile->accel_ms))	interval_ms -= profile->accel_ms;
+			else									interval_ms = profile->min_interval_ms;
+			break;
+
+		case STATE_RELEASED:
+			if(!repeat_sent()) return;
+			events_repeat(repeat_key, true, repeat_role);
+			state = STATE_HELD;
+			break;
+	}
+}
+
+// Returns true if a profile can be used.
+bool repeat_profile_valid(const repeat_profile_t *profile)
+{
+	return(profile->interval_ms && profile->min_interval_ms && (profile->min_interval_ms <= profile->interval_ms));
+}
@@ -0,0 +1,120 @@
+// Runtime settings - see settings.h.
+
+#include "settings.h"
+#include "leds.h"
+
+// The settings in use.
+settings_t settings;
+
+// The default mouse key curve and auto-repeat profiles.
+static const mousekey_profile_t mouse_default PROGMEM = MOUSEKEY_DEFAULT;
+static const repeat_profile_t repeat_defaults[REPEAT_CLASSES] PROGMEM =
+{
+	[REPEAT_KEYS]		= REPEAT_KEYS_DEFAULT,
+	[REPEAT_CONSUMER]	= REPEAT_CONSUMER_DEFAULT,
+	[REPEAT_MACROS]		= REPEAT_MACROS_DEFAULT,
+};
+
+// The journal, and the slot and sequence number of its newest good record (newest is SETTINGS_RECORDS if there is none).
+static settings_record_t EEMEM ee_journal[SETTINGS_RECORDS];
+static uint8_t newest = SETTINGS_RECORDS;
+static uint16_t sequence = 0;
+
+// The settings as last loaded or saved.
+static settings_t saved;
+
+// The record being written, where to and the next byte to write (write_index == sizeof(record) when not writing).
+static settings_record_t record;
+static uint8_t write_slot;
+static uint8_t write_index = sizeof(settings_record_t);
+
+// Set (with the time) whenever a setting changes.
+static volatile bool changed = false;
+static volatile uint16_t changed_ms;
+
+// Returns the CRC of a record.
+static uint16_t record_crc(const settings_record_t *r)
+{
+	uint16_t crc = SETTINGS_MAGIC;
+	const uint8_t *bytes = (const uint8_t *)r;
+
+	for(uint8_t i = 0; i < offsetof(settings_record_t, crc); i++) crc = _crc16_update(crc, bytes[i]);
+	return(crc);
+}
+
+// Load the newest good record of the journal, or the defaults if there is none.
+void settings_init(void)
+{
+	settings_record_t r;
+
+	settings.led_mode = START_MODE;
+	settings.led_effects = LEDS_EFFECTS_ALL;
+	settings.macro_pace.frames = MACRO_PACE_FRAMES;
+	settings.macro_pace.gap_ms = MACRO_PACE_GAP_MS;
+	memcpy_P(settings.repeat, repeat_defaults, sizeof(repeat_defaults));
+	memcpy_P(&settings.mouse, &mouse_default, sizeof(mouse_default));
+	newest = SETTINGS_RECORDS;
+
+	for(uint8_t slot = 0; slot < SETTINGS_RECORDS; slot++)
+	{
+		eeprom_read_block(&r, &ee_journal[slot], sizeof(settings_record_t));
+		if(r.crc != record_crc(&r)) continue;
+
+		// The records in the ring are never more than SETTINGS_RECORDS apart, so the sequence numbers compare across a wrap.
+		if((newest == SETTINGS_RECORDS) || ((int16_t)(r.sequence - sequence) > 0))
+		{
+			newest = slot;
+			sequence = r.sequence;
+			settings = r.settings;
+		}
+	}
+
+	saved = settings;
+}
+
+// Note that a setting has changed, so the settings are saved once they have stayed the same for SETTINGS_DELAY_MS.
+void settings_changed(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		changed = true;
+		changed_ms = systick_ms();
+	}
+}
+
+// Write the next byte of a record, or start a new record once the settings have settled.  Called every pass of the main loop.
+void settings_task(void)
+{
+	// Carry on with a record, a byte at a time as the EEPROM is ready.
+	if(write_index < sizeof(record))
+	{
+		if(!eeprom_is_ready()) return;
+
+		eeprom_update_byte(((uint8_t *)&ee_journal[write_slot]) + write_index, ((uint8_t *)&record)[write_index]);
+		if(++write_index == sizeof(record))
+		{
+			// All written - this is now the newest record.
+			newest = write_slot;
+			sequence = record.sequence;
+			saved = record.settings;
+		}
+		return;
+	}
+
+	// Take a copy of the settings once they have settled.
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(!changed || ((uint16_t)(systick_ms() - changed_ms) < SETTINGS_DELAY_MS)) return;
+
+		changed = false;
+		record.settings = settings;
+	}
+
+	// Nothing to save if they have come back to what was saved last.
+	if(!memcmp(&record.settings, &saved, sizeof(settings_t))) return;
+
+	record.sequence = sequence + 1;
+	record.crc = record_crc(&record);
+	write_slot = ((newest < (SETTINGS_RECORDS - 1)) ? (newest + 1) : 0);
+	write_index = 0;
+}
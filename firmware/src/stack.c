@@ -0,0 +1,54 @@
+// RAM and stack use - see stack.h.
+
+#include "stack.h"
+
+// Section boundaries, from the linker script.
+extern uint8_t __data_start;
+extern uint8_t __data_end;
+extern uint8_t __bss_start;
+extern uint8_t __bss_end;
+extern uint8_t __noinit_start;
+extern uint8_t __noinit_end;
+extern uint8_t _end;
+
+// Fill the RAM between the static variables and the stack with the canary.  Run by the C start-up code, after the stack pointer is
+// set up but before the static variables are, so it must not call anything or use the stack itself.
+void stack_paint(void) __attribute__((naked, used, section(".init3")));
+void stack_paint(void)
+{
+	uint8_t *p = &_end;
+
+	while(p < (uint8_t *)SP) *p++ = STACK_CANARY;
+}
+
+// Returns the bytes of canary left at the bottom of the free space (the headroom the stack has never reached).
+static uint16_t headroom(void)
+{
+	const uint8_t *p = &_end;
+
+	while((p <= (uint8_t *)RAMEND) && (*p == STACK_CANARY)) p++;
+	return(p - &_end);
+}
+
+// Fill in the sizes of the static RAM sections, and the depth and headroom of the stack.
+void stack_read(stack_stats_t *stats)
+{
+	stats->ram = (RAMEND - RAMSTART + 1);
+	stats->data = (&__data_end - &__data_start);
+	stats->bss = (&__bss_end - &__bss_start);
+	stats->noinit = (&__noinit_end - &__noinit_start);
+	stats->stack_now = (RAMEND - SP);
+	stats->headroom = headroom();
+	stats->stack_peak = ((RAMEND + 1) - (uint16_t)(&_end + stats->headroom));
+}
+
+// Paint the free space below the stack again, so the peak is measured from now on.
+void stack_repaint(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uint8_t *p = &_end;
+
+		while(p < (uint8_t *)SP) *p++ = STACK_CANARY;
+	}
+}
@@ -0,0 +1,67 @@
+#include "systick.h"
+
+// Tick and millisecond counters.  Both are free-running and wrap, so always compare them by subtraction.
+static volatile uint16_t ticks = 0;
+static volatile uint16_t milliseconds = 0;
+
+// Initialise the tick timer.
+void systick_init(void)
+{
+	// WGM[3:0] set to 0100 : CTC mode, counts from 0 to value of output compare register.
+	// COM[1:0] set to 00 : Normal pin modes - not connected to timer.
+	// CS[2:0] set to 010 : clk/8 (from prescaler) = 2MHz.  OCR = (2MHz / 4kHz) - 1 = 499.
+	SYSTICK_SET_REG = SYSTICK_TOP;
+	SYSTICK_TCCRB |= ((1 << SYSTICK_WGM2) | (1 << SYSTICK_CS1));
+
+	// Enable the output compare interrupt.
+	SYSTICK_TIMSK |= (1 << SYSTICK_IE);
+}
+
+// Keep the tick rate whilst the cpu clock is divided by 8 (slow = true, see governor.h) or back at full speed.  The timer counts at
+// 2MHz either way: clk/8 at full speed, clk/1 when slow.
+void systick_slow_clock(bool slow)
+{
+	if(slow)	SYSTICK_TCCRB = ((SYSTICK_TCCRB & ~(1 << SYSTICK_CS1)) | (1 << SYSTICK_CS0));
+	else		SYSTICK_TCCRB = ((SYSTICK_TCCRB & ~(1 << SYSTICK_CS0)) | (1 << SYSTICK_CS1));
+}
+
+// Advance the counters when the tick timer interrupt is triggered.  Returns true if a millisecond has passed.
+bool systick_handle_interrupt(void)
+{
+	ticks++;
+	if(ticks % SYSTICK_TICKS_PER_MS) return(false);
+
+	milliseconds++;
+	return(true);
+}
+
+// Returns the current tick count.
+uint16_t systick_ticks(void)
+{
+	uint16_t t;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) t = ticks;
+	return(t);
+}
+
+// Returns the number of milliseconds elapsed (modulo 65536).
+uint16_t systick_ms(void)
+{
+	uint16_t ms;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) ms = milliseconds;
+	return(ms);
+}
+
+// Returns the number of cpu cycles elapsed (modulo SYSTICK_CYCLES_WRAP), to within SYSTICK_PRESCALER cycles.
+uint32_t systick_cycles(void)
+{
+	uint16_t t, count;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		t = ticks;
+		count = SYSTICK_COUNT;
+
+		// With interrupts off the timer may have started a new tick that the counter does not have yet.
+		if((SYSTICK_TIFR & (1 << SYSTICK_IF)) && (count < (SYSTICK_TOP / 2))) t++;
+	}
+	return((((uint32_t)t * (SYSTICK_TOP + 1)) + count) * SYSTICK_PRESCALER);
+}
@@ -0,0 +1,135 @@
+// Tap-hold resolution engine - see taphold.h.
+
+#include "taphold.h"
+
+// A key event with the time (systick_ms()) it happened.
+typedef struct
+{
+	uint8_t key;
+	bool pressed;
+	uint16_t time;
+} timed_event_t;
+
+// The undecided dual-role key.
+static bool pending = false;
+static uint8_t pending_key;
+static uint16_t pending_time;
+
+// Events held back whilst a key is undecided.  One extra slot for the event that causes the decision.
+static timed_event_t buffer[TAPHOLD_BUFFER_SIZE + 1];
+static uint8_t buffer_count = 0;
+
+// Events still to be processed.  When a key is decided the buffered events are put back in front of these and processed again,
+// since one of them may be another dual-role key.
+static timed_event_t queue[TAPHOLD_BUFFER_SIZE + 1];
+static uint8_t queue_pos = 0;
+static uint8_t queue_count = 0;
+
+// Nothing undecided.
+void taphold_init(void)
+{
+	pending = false;
+	buffer_count = 0;
+	queue_pos = queue_count = 0;
+}
+
+// Decide the undecided key, send it on with its role and put the buffered events back in the queue.
+static void taphold_decide(uint8_t role)
+{
+	uint8_t remaining = queue_count - queue_pos;
+
+	pending = false;
+	events_output(pending_key, true, role);
+
+	memmove(&queue[buffer_count], &queue[queue_pos], remaining * sizeof(timed_event_t));
+	memcpy(&queue[0], &buffer[0], buffer_count * sizeof(timed_event_t));
+	queue_pos = 0;
+	queue_count = buffer_count + remaining;
+	buffer_count = 0;
+}
+
+// Process a single event.
+static void taphold_step(const timed_event_t *event)
+{
+	if(!pending)
+	{
+		// A dual-role key going down becomes undecided, anything else (including combos) passes straight through.
+		if(event->pressed && (event->key < MATRIX_KEYS) && KC_IS_TAP_HOLD(layers_peek(event->key)))
+		{
+			pending = true;
+			pending_key = event->key;
+			pending_time = event->time;
+		}
+		else events_output(event->key, event->pressed, ROLE_KEY);
+
+		return;
+	}
+
+	// Hold the event back.
+	buffer[buffer_count++] = *event;
+
+	// The undecided key was released - a tap unless the tapping term had already passed.
+	if((event->key == pending_key) && !event->pressed)
+	{
+		if((uint16_t)(event->time - pending_time) < TAPPING_TERM_MS)	taphold_decide(ROLE_TAP);
+		else								taphold_decide(ROLE_HOLD);
+		return;
+	}
+
+	// Out of buffer space.
+	if(buffer_count > TAPHOLD_BUFFER_SIZE)
+	{
+		taphold_decide(ROLE_HOLD);
+		return;
+	}
+
+#ifdef HOLD_ON_OTHER_KEY_PRESS
+	// Another key went down.
+	if(event->pressed) taphold_decide(ROLE_HOLD);
+#elif defined(PERMISSIVE_HOLD)
+	// Another key was released after going down whilst the key was undecided (i.e. it was tapped within the tapping term).
+	if(!event->pressed)
+	{
+		for(uint8_t i = 0; i < (buffer_count - 1); i++)
+		{
+			if((buffer[i].key == event->key) && buffer[i].pressed)
+			{
+				taphold_decide(ROLE_HOLD);
+				break;
+			}
+		}
+	}
+#endif
+}
+
+// Process everything in the queue.
+static void taphold_run(void)
+{
+	while(queue_pos < queue_count)
+	{
+		timed_event_t event = queue[queue_pos++];
+		taphold_step(&event);
+	}
+
+	queue_pos = queue_count = 0;
+}
+
+// A key went down or up at the given time.
+void taphold_event(uint8_t key, bool pressed, uint16_t time)
+{
+	queue[queue_count].key = key;
+	queue[queue_count].pressed = pressed;
+	queue[queue_count].time = time;
+	queue_count++;
+
+	taphold_run();
+}
+
+// Decide an undecided key as a hold once the tapping term has passed.
+void taphold_task(uint16_t now)
+{
+	if(!pending || ((uint16_t)(now - pending_time) < TAPPING_TERM_MS)) return;
+
+	taphold_decide(ROLE_HOLD);
+	taphold_run();
+}
@@ -0,0 +1,254 @@
+// Vendor interface command handling - see vendor.h.
+
+#include "vendor.h"
+
+// The reply to the last command, returned by the next get feature report.
+static uint8_t reply[VENDOR_REPORT_SIZE];
+
+// Carry out a command sent by the host.
+void vendor_set_report(const uint8_t *report)
+{
+	uint8_t status = VENDOR_STATUS_OK;
+	uint8_t *data = &reply[2];
+
+	memset(reply, 0, sizeof(reply));
+
+	switch(report[0])
+	{
+		case VENDOR_CMD_NOP:
+			break;
+
+		case VENDOR_CMD_KEYMAP_INFO:
+			data[0] = keymap_num_layers;
+			data[1] = MATRIX_ROWS;
+			data[2] = MATRIX_COLS;
+			data[3] = remap_count();
+			data[4] = REMAP_MAX_OVERRIDES;
+			break;
+
+		case VENDOR_CMD_KEYMAP_GET:
+			if((report[1] >= keymap_num_layers) || (report[2] >= MATRIX_KEYS))
+			{
+				status = VENDOR_STATUS_BAD_ARG;
+				break;
+			}
+			keycode_t keycode = keymap_ram[((uint16_t)report[1] * MATRIX_KEYS) + report[2]];
+			data[0] = (keycode & 0xFF);
+			data[1] = (keycode >> 8);
+			break;
+
+		case VENDOR_CMD_KEYMAP_SET:
+			status = remap_set(report[1], report[2], (report[3] | ((keycode_t)report[4] << 8)));
+			break;
+
+		case VENDOR_CMD_KEYMAP_RESET:
+			remap_reset();
+			break;
+
+		case VENDOR_CMD_MACROS_INFO: ;
+			uint8_t bank = macrostore_bank();
+			data[0] = SPM_PAGESIZE;
+			data[1] = (MACROSTORE_BANK_SIZE & 0xFF);
+			data[2] = (MACROSTORE_BANK_SIZE >> 8);
+			data[3] = bank;
+			if(bank != MACROSTORE_NONE)
+			{
+				memcpy_P(&data[4], &macrostore_header(bank)->sequence, sizeof(uint16_t));
+				memcpy_P(&data[6], &macrostore_header(bank)->length, sizeof(uint16_t));
+			}
+			break;
+
+		case VENDOR_CMD_MACROS_BEGIN:
+			status = macrostore_begin(report[1] | ((uint16_t)report[2] << 8));
+			break;
+
+		case VENDOR_CMD_MACROS_DATA:
+			if(report[3] > VENDOR_DATA_MAX) status = VENDOR_STATUS_BAD_ARG;
+			else				status = macrostore_data((report[1] | ((uint16_t)report[2] << 8)), &report[4], report[3]);
+			break;
+
+		case VENDOR_CMD_MACROS_COMMIT:
+			status = macrostore_commit(report[1] | ((uint16_t)report[2] << 8));
+			break;
+
+		case VENDOR_CMD_MACROS_PACE:
+			if(report[1])
+			{
+				settings.macro_pace.frames = report[1];
+				settings.macro_pace.gap_ms = report[2];
+				settings_changed();
+			}
+			data[0] = settings.macro_pace.frames;
+			data[1] = settings.macro_pace.gap_ms;
+			break;
+
+#ifdef PROFILE
+		case VENDOR_CMD_PROFILE_INFO:
+			data[0] = PROFILE_NUM_PROBES;
+			data[1] = SYSTICK_PRESCALER;
+			data[2] = ((F_CPU / 1000) & 0xFF);
+			data[3] = ((F_CPU / 1000) >> 8);
+			break;
+
+		case VENDOR_CMD_PROFILE_READ:
+			if(report[1] >= PROFILE_NUM_PROBES)
+			{
+				status = VENDOR_STATUS_BAD_ARG;
+				break;
+			}
+			profile_probe_t counters;
+			profile_read(report[1], &counters);
+			memcpy(&data[0], &counters.calls, sizeof(uint32_t));
+			memcpy(&data[4], &counters.cycles, sizeof(uint32_t));
+			memcpy(&data[8], &counters.max_cycles, sizeof(uint32_t));
+			strcpy_P((char *)&data[12], profile_name(report[1]));
+			break;
+
+		case VENDOR_CMD_PROFILE_RESET:
+			profile_reset();
+			break;
+#endif
+
+		case VENDOR_CMD_BOUNCE_START:
+			bounce_start(matrix);
+			data[0] = SYSTICK_TICKS_PER_MS;
+			data[1] = BOUNCE_MAX_TICKS;
+			break;
+
+		case VENDOR_CMD_BOUNCE_STOP:
+			data[0] = bounce_stop(report[1] == 1);
+			break;
+
+		case VENDOR_CMD_BOUNCE_READ:
+			if(report[1] >= MATRIX_KEYS)
+			{
+				status = VENDOR_STATUS_BAD_ARG;
+				break;
+			}
+			bounce_stats_t stats;
+			bounce_read(report[1], &stats);
+			data[0] = (stats.edges & 0xFF);
+			data[1] = (stats.edges >> 8);
+			data[2] = stats.chatter;
+			data[3] = stats.bounce_ticks;
+			data[4] = bounce_window[report[1]];
+			break;
+
+		case VENDOR_CMD_BOUNCE_SET:
+			status = bounce_set(report[1], report[2]);
+			break;
+
+		case VENDOR_CMD_BOUNCE_RESET:
+			bounce_reset();
+			break;
+
+		case VENDOR_CMD_BOOT_TIMES:
+			memcpy(data, &boot_stats, sizeof(boot_stats_t));
+			break;
+
+		case VENDOR_CMD_RAM:
+			if(report[1] == 1) stack_repaint();
+			stack_stats_t ram_stats;
+			stack_read(&ram_stats);
+			memcpy(data, &ram_stats, sizeof(stack_stats_t));
+			break;
+
+		case VENDOR_CMD_SCAN_STATS: ;
+			uint8_t *next = data;
+			*next++ = governor_stats.level;
+			for(uint8_t i = 0; i < NUM_SCAN_RATES; i++)
+			{
+				*next++ = (governor_stats.level_entries[i] & 0xFF);
+				*next++ = (governor_stats.level_entries[i] >> 8);
+			}
+			*next++ = (governor_stats.wakeups & 0xFF);
+			*next++ = (governor_stats.wakeups >> 8);
+			*next++ = governor_stats.slow_clock;
+			*next++ = (keyscan_stats.row_settle_cycles & 0xFF);
+			*next++ = (keyscan_stats.row_settle_cycles >> 8);
+			*next++ = (keyscan_stats.recovery_faults & 0xFF);
+			*next++ = (keyscan_stats.recovery_faults >> 8);
+			*next = KEYSCAN_SETTLE_CYCLES;
+			break;
+
+		case VENDOR_CMD_LEDS_EFFECTS:
+			if(report[1] == 1)
+			{
+				settings.led_effects = (report[2] & LEDS_EFFECTS_ALL);
+				settings_changed();
+			}
+			data[0] = settings.led_effects;
+			break;
+
+		case VENDOR_CMD_REPEAT:
+			if(report[1] >= REPEAT_CLASSES)
+			{
+				status = VENDOR_STATUS_BAD_ARG;
+				break;
+			}
+			repeat_profile_t *profile = &settings.repeat[report[1]];
+			if(report[2] == 1)
+			{
+				repeat_profile_t set =
+				{
+					.delay_ms = (report[3] | ((uint16_t)report[4] << 8)),
+					.interval_ms = report[5],
+					.min_interval_ms = report[6],
+					.accel_ms = report[7],
+				};
+				if(!repeat_profile_valid(&set))
+				{
+					status = VENDOR_STATUS_BAD_ARG;
+					break;
+				}
+				*profile = set;
+				settings_changed();
+			}
+			data[0] = (profile->delay_ms & 0xFF);
+			data[1] = (profile->delay_ms >> 8);
+			data[2] = profile->interval_ms;
+			data[3] = profile->min_interval_ms;
+			data[4] = profile->accel_ms;
+			break;
+
+		case VENDOR_CMD_MOUSE:
+			if(report[1] == 1)
+			{
+				mousekey_profile_t set =
+				{
+					.curve = report[2],
+					.start = (report[3] | ((uint16_t)report[4] << 8)),
+					.max = (report[5] | ((uint16_t)report[6] << 8)),
+					.accel = (report[7] | ((uint16_t)report[8] << 8)),
+				};
+				if(!mousekey_profile_valid(&set))
+				{
+					status = VENDOR_STATUS_BAD_ARG;
+					break;
+				}
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE) settings.mouse = set;
+				settings_changed();
+			}
+			data[0] = settings.mouse.curve;
+			data[1] = (settings.mouse.start & 0xFF);
+			data[2] = (settings.mouse.start >> 8);
+			data[3] = (settings.mouse.max & 0xFF);
+			data[4] = (settings.mouse.max >> 8);
+			data[5] = (settings.mouse.accel & 0xFF);
+			data[6] = (settings.mouse.accel >> 8);
+			break;
+
+		default:
+			status = VENDOR_STATUS_UNKNOWN;
+			break;
+	}
+
+	reply[0] = report[0];
+	reply[1] = status;
+}
+
+// Fill in the reply to the last command.
+void vendor_get_report(uint8_t *report)
+{
+	memcpy(report, reply, VENDOR_REPORT_SIZE);
+}
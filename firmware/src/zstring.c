@@ -0,0 +1,37 @@
+// Compressed macro text decoder - see zstring.h and tools/macrozip.py.
+
+#include "zstring.h"
+
+// The string for a bad index - just the end code.
+static const uint8_t zstring_empty[] PROGMEM = {0x00};
+
+// Start decoding string number index.
+void zstring_open(zstring_t *zstring, uint8_t index)
+{
+	if(index < MACROTEXT_COUNT)	zstring->next = &macrotext_data[pgm_read_word(&macrotext_offsets[index])];
+	else				zstring->next = zstring_empty;
+	zstring->remaining = 0;
+}
+
+// Returns the next character of the string, or 0 at the end.
+char zstring_next(zstring_t *zstring)
+{
+	// Carry on through a dictionary entry.
+	if(zstring->remaining)
+	{
+		zstring->remaining--;
+		return(pgm_read_byte(zstring->entry++));
+	}
+
+	// Codes 0x01 to 0x7F are literal characters, 0x00 is the end (which is not passed).
+	uint8_t code = pgm_read_byte(zstring->next);
+	if(!code) return(0);
+	zstring->next++;
+	if(code < 0x80) return(code);
+
+	// Codes 0x80 and above expand to a dictionary entry.
+	uint16_t start = pgm_read_word(&macrotext_dict_offsets[code & 0x7F]);
+	zstring->entry = &macrotext_dict[start];
+	zstring->remaining = (pgm_read_word(&macrotext_dict_offsets[(code & 0x7F) + 1]) - start - 1);
+	return(pgm_read_byte(zstring->entry++));
+}
@@ -0,0 +1,378 @@
+#!/usr/bin/env python3
+# Keymap compiler.  Compiles a keymap description (see demo.km for the format) into the packed PROGMEM tables used by the firmware:
+# the layers (KEYMAPS), the macros (macro_data and macro_offsets, see keymap.h), the combos (COMBOS) and the compressed macro text
+# (see zstring.h).  Keycodes, layer numbers, matrix positions and sizes are checked against keymap.h and keyscan.h, and the flash
+# and RAM used by each layer and macro is printed against the budgets given in the description.
+#
+# Run by the makefile before anything else is built.  Errors and the usage breakdown go to stderr; the generated files are only
+# rewritten when they change.
+#
+# Usage: tools/kmc.py keymap.km gen_dir include_dir
+
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import macrozip
+
+# Packed macro actions (keymap.h).
+M_NULL, M_STRING, M_KEYS, M_WAIT, M_ZSTRING, M_PACE = 'M_NULL', 'M_STRING', 'M_KEYS', 'M_WAIT', 'M_ZSTRING', 'M_PACE'
+
+# The paces (frames, gap ms - see macroplay.h) a calibrate action types its test line at, fastest first, and the test line.  The
+# line has repeated letters, shifted characters and digits, as those are what a slow host drops first.
+CALIBRATION_PACES = [(1, 0), (1, 4), (2, 4), (2, 8), (3, 12), (4, 16), (6, 24), (8, 32)]
+CALIBRATION_TEXT = 'The quick brown fox jumps over the lazy dog - THE QUICK BROWN FOX 0123456789 (aabbcc!!)\n'
+
+class KeymapError(Exception): pass
+
+def fail(where, message):
+	raise KeymapError('%s: %s' % (where, message))
+
+# Read the #define NAME value lines of a header (only the values that are plain numbers are kept).
+def read_defines(path):
+	defines = {}
+	with open(path) as f:
+		for line in f:
+			match = re.match(r'\s*#define\s+(\w+)\s+(0x[0-9A-Fa-f]+|\d+)\b', line)
+			if match: defines[match.group(1)] = int(match.group(2), 0)
+	return defines
+
+class Compiler:
+	def __init__(self, defines):
+		self.d = defines
+		self.rows, self.cols = defines['MATRIX_ROWS'], defines['MATRIX_COLS']
+		self.keyboard = {n[len('HID_KEYBOARD_SC_'):]: v for n, v in defines.items() if n.startswith('HID_KEYBOARD_SC_')}
+		for n in ('MACRO_FIRST', 'MACRO_LAST'): self.keyboard.pop(n, None)
+		self.media = {'MEDIA_' + n[len('HID_MEDIACONTROLLER_SC_'):]: v for n, v in defines.items() if n.startswith('HID_MEDIACONTROLLER_SC_')}
+		self.modifiers = {n: v for n, v in self.keyboard.items() if defines['HID_KEYBOARD_SC_LEFT_CONTROL'] <= v <= defines['HID_KEYBOARD_SC_RIGHT_GUI']}
+		self.budgets = {}
+		self.layers = {}		# Number -> (where, rows of keycode tokens).
+		self.macros = []		# (name, where, actions).
+		self.combos = []		# (where, positions, keycode token).
+
+	# Returns the C expression for a basic keyboard scan-code.
+	def basic_key(self, where, name, modifiers_only=False):
+		table = self.modifiers if modifiers_only else self.keyboard
+		if name not in table: fail(where, 'unknown %s "%s"' % ('modifier' if modifiers_only else 'key', name))
+		return 'HID_KEYBOARD_SC_' + name
+
+	def number(self, where, text, low, high, what):
+		if not re.match(r'^\d+$', text.strip()): fail(where, '%s "%s" is not a number' % (what, text))
+		value = int(text)
+		if not low <= value <= high: fail(where, '%s %d out of range (%d to %d)' % (what, value, low, high))
+		return value
+
+	# Returns the C expression for a keycode token.
+	def keycode(self, where, token):
+		match = re.match(r'^(\w+)\((.*)\)$', token)
+		if match:
+			function, args = match.group(1), [a.strip() for a in match.group(2).split(',')]
+			if function in ('MO', 'TG', 'OSL') and len(args) == 1:
+				return '%s(%d)' % (function, self.number(where, args[0], 0, self.d['MAX_LAYERS'] - 1, 'layer'))
+			if function == 'LT' and len(args) == 2:
+				layer = self.number(where, args[0], 0, 7, 'layer')
+				return 'LT(%d, %s)' % (layer, self.basic_key(where, args[1]))
+			if function == 'MT' and len(args) == 2:
+				return 'MT(%s, %s)' % (self.basic_key(where, args[0], True), self.basic_key(where, args[1]))
+			if function == 'MACRO' and len(args) == 1:
+				names = [m[0] for m in self.macros]
+				if args[0] not in names: fail(where, 'unknown macro "%s"' % args[0])
+				return 'MACRO(MACRO_ID_%s)' % args[0].upper()
+			if function == 'CONSUMER' and len(args) == 1:
+				if not re.match(r'^(0x[0-9A-Fa-f]+|\d+)$', args[0]): fail(where, 'consumer usage "%s" is not a number' % args[0])
+				usage = int(args[0], 0)
+				if not 0x001 <= usage <= 0xFFF: fail(where, 'consumer usage 0x%X out of range (0x001 to 0xFFF)' % usage)
+				return 'CONSUMER(0x%03X)' % usage
+			if function == 'SMACRO' and len(args) == 1:
+				return 'SMACRO(%d)' % self.number(where, args[0], 0, 255, 'stored macro')
+			fail(where, 'unknown function "%s"' % token)
+		if token in ('_', 'TRNS'): return 'KC_TRNS'
+		if token == 'NO': return '0x00'
+		if token in ('DM_REC', 'DM_STOP', 'DM_PLAY', 'DM_FAST', 'DM_SAVE'): return token
+		if token in ('MS_UP', 'MS_DOWN', 'MS_LEFT', 'MS_RIGHT', 'MS_BTN1', 'MS_BTN2', 'MS_BTN3', 'MS_WH_UP', 'MS_WH_DOWN'): return token
+		if token in self.media: return 'HID_MEDIACONTROLLER_SC_' + token[len('MEDIA_'):]
+		return self.basic_key(where, token)
+
+	# Split a line into keycode tokens (a function call with its arguments is one token).
+	@staticmethod
+	def tokens(line):
+		return re.findall(r'\w+\([^)]*\)|[^\s()]+', line)
+
+	def parse(self, path):
+		block = None
+		with open(path) as f:
+			for number, line in enumerate(f, 1):
+				where = '%s:%d' % (path, number)
+				line = strip_comment(line).rstrip()
+				if not line.strip(): continue
+				indented = line[0].isspace()
+				words = line.split()
+
+				if not indented:
+					block = None
+					if words[0] == 'budget' and len(words) == 3 and words[1] in ('flash', 'ram'):
+						self.budgets[words[1]] = self.number(where, words[2], 0, 65535, 'budget')
+					elif words[0] == 'layer' and len(words) == 2:
+						layer = self.number(where, words[1], 0, self.d['MAX_LAYERS'] - 1, 'layer')
+						if layer in self.layers: fail(where, 'layer %d defined twice' % layer)
+						self.layers[layer] = (where, [])
+						block = ('layer', self.layers[layer][1])
+					elif words[0] == 'macro' and len(words) == 2 and re.match(r'^[A-Za-z_]\w*$', words[1]):
+						if words[1].upper() in [m[0].upper() for m in self.macros]: fail(where, 'macro "%s" defined twice' % words[1])
+						self.macros.append((words[1], where, []))
+						block = ('macro', self.macros[-1][2])
+					elif words[0] == 'combo' and '=' in line:
+						keys, keycode = line[len('combo'):].split('=', 1)
+						self.combos.append((where, keys.split(), keycode.strip()))
+					else: fail(where, 'expected budget, layer, macro or combo')
+					continue
+
+				if not block: fail(where, 'indented line outside a layer or macro')
+				block[1].append((where, line.strip()))
+
+	def compile(self):
+		if not self.layers: fail('keymap', 'no layers')
+		if sorted(self.layers) != list(range(len(self.layers))): fail('keymap', 'layers must be numbered 0 to %d' % (len(self.layers) - 1))
+		if len(self.macros) > self.d['HID_KEYBOARD_SC_MACRO_LAST'] - self.d['HID_KEYBOARD_SC_MACRO_FIRST'] + 1:
+			fail('keymap', 'too many macros (%d)' % len(self.macros))
+		if len(self.combos) > self.d['MAX_COMBOS']: fail('keymap', 'too many combos (most is MAX_COMBOS, %d)' % self.d['MAX_COMBOS'])
+
+		# Layers.
+		self.layer_rows = []
+		for layer in range(len(self.layers)):
+			where, rows = self.layers[layer]
+			if len(rows) != self.rows: fail(where, 'layer %d has %d rows, the matrix has %d' % (layer, len(rows), self.rows))
+			compiled = []
+			for row_where, row in rows:
+				keys = self.tokens(row)
+				if len(keys) != self.cols: fail(row_where, '%d keys, the matrix has %d columns' % (len(keys), self.cols))
+				for key in keys:
+					match = re.match(r'^(MO|TG|OSL|LT)\((\d+)', key)
+					if match and int(match.group(2)) >= len(self.layers): fail(row_where, '%s refers to a layer that is not defined' % key)
+				compiled.append([self.keycode(row_where, k) for k in keys])
+			self.layer_rows.append(compiled)
+
+		# Macros.  Consecutive strings are typed as one piece of text.
+		self.texts = []
+		self.macro_actions = []
+		for name, where, lines in self.macros:
+			actions = []
+			for line_where, line in lines:
+				words = line.split(None, 1)
+				if words[0] == 'string' and len(words) == 2:
+					text = parse_string(line_where, words[1])
+					if actions and actions[-1][0] == 'text': actions[-1] = ('text', actions[-1][1] + text)
+					else: actions.append(('text', text))
+				elif words[0] == 'keys' and len(words) == 2:
+					keys = [self.basic_key(line_where, k) for k in words[1].split()]
+					if sum(1 for k in words[1].split() if k not in self.modifiers) > self.d['MAX_KEYS']:
+						fail(line_where, 'more than MAX_KEYS (%d) keys besides modifiers' % self.d['MAX_KEYS'])
+					for k in words[1].split():
+						if self.keyboard[k] > self.d['HID_KEYBOARD_SC_RIGHT_GUI']: fail(line_where, '%s cannot be used in a macro' % k)
+					actions.append(('keys', keys))
+				elif words[0] == 'wait' and len(words) == 2:
+					match = re.match(r'^(\d+)(ms|s)$', words[1])
+					if not match: fail(line_where, 'expected a wait in ms or s (e.g. 500ms), not "%s"' % words[1])
+					ms = int(match.group(1)) * (1000 if match.group(2) == 's' else 1)
+					if not 1 <= ms <= 3600000: fail(line_where, 'wait out of range (1ms to 3600s)')
+					while ms:
+						actions.append(('wait', min(ms, 65535)))
+						ms -= actions[-1][1]
+				elif words[0] == 'pace' and len(words) == 2 and len(words[1].split()) == 2:
+					frames, gap = words[1].split()
+					actions.append(('pace', self.number(line_where, frames, 1, 255, 'pace frames'), self.number(line_where, gap, 0, 255, 'pace gap')))
+				elif words[0] == 'calibrate' and len(words) == 1:
+					for frames, gap in CALIBRATION_PACES:
+						actions.append(('pace', frames, gap))
+						actions.append(('text', 'pace %d %d: %s' % (frames, gap, CALIBRATION_TEXT)))
+				else: fail(line_where, 'expected string, keys, wait, pace or calibrate')
+			if not actions: fail(where, 'macro "%s" is empty' % name)
+			for action in actions:
+				if action[0] == 'text':
+					for c in action[1]:
+						if not 0x01 <= ord(c) <= 0x7F: fail(where, 'character %r in macro "%s" is not 7-bit ASCII' % (c, name))
+					self.texts.append(action[1])
+			self.macro_actions.append(actions)
+		if len(self.texts) > 256: fail('keymap', 'more than 256 pieces of macro text')
+
+		# Compress all the text against one dictionary, then use whichever of the plain or compressed form is smaller for each.
+		self.dictionary = macrozip.build_dictionary(self.texts)
+		self.zstrings = []
+		self.macro_bytes = []
+		self.macro_sizes = []
+		for (name, _, _), actions in zip(self.macros, self.macro_actions):
+			data, size = [], 0
+			for action in actions:
+				if action[0] == 'text':
+					codes = macrozip.encode(action[1], self.dictionary)
+					if len(action[1]) <= 255 and len(action[1]) + 2 <= len(codes) + 5:
+						data.append(([M_STRING, str(len(action[1]))] + [c_char(c) for c in action[1]], 'type "%s"' % c_comment(action[1])))
+						size += 2 + len(action[1])
+					else:
+						self.zstrings.append((name, action[1], codes))
+						data.append(([M_ZSTRING, 'TXT_%s_%d' % (name.upper(), len(self.zstrings) - 1)], 'type "%s"' % c_comment(action[1][:40] + ('...' if len(action[1]) > 40 else ''))))
+						size += 2 + len(codes) + 1 + 2
+				elif action[0] == 'keys':
+					data.append(([M_KEYS, str(len(action[1]))] + action[1], None))
+					size += 2 + len(action[1])
+				elif action[0] == 'wait':
+					data.append(([M_WAIT, str(action[1] & 0xFF), str(action[1] >> 8)], 'wait %dms' % action[1]))
+					size += 3
+				elif action[0] == 'pace':
+					data.append(([M_PACE, str(action[1]), str(action[2])], None))
+					size += 3
+			data.append(([M_NULL], None))
+			size += 1 + 2
+			self.macro_bytes.append(data)
+			self.macro_sizes.append(size)
+
+		# Combos.
+		self.combo_entries = []
+		for where, keys, keycode in self.combos:
+			if not 2 <= len(keys) <= self.d['COMBO_MAX_KEYS']: fail(where, 'a combo has 2 to COMBO_MAX_KEYS (%d) keys' % self.d['COMBO_MAX_KEYS'])
+			positions = []
+			for key in keys:
+				match = re.match(r'^(\d+),(\d+)$', key)
+				if not match: fail(where, 'expected row,column, not "%s"' % key)
+				r, c = int(match.group(1)), int(match.group(2))
+				if r >= self.rows or c >= self.cols: fail(where, 'no key at %d,%d' % (r, c))
+				positions.append('KEY_POS(%d, %d)' % (r, c))
+			if len(set(positions)) != len(positions): fail(where, 'a key is listed twice')
+			positions += ['COMBO_END'] * (self.d['COMBO_MAX_KEYS'] - len(positions))
+			self.combo_entries.append((positions, self.keycode(where, keycode), ' '.join(keys) + ' = ' + keycode))
+
+	def write(self, source, gen_dir):
+		layer_size = self.rows * self.cols * 2
+		dict_size = sum(len(e) for e in self.dictionary) + 2 * (len(self.dictionary) + 1)
+		combo_size = len(self.combo_entries) * (self.d['COMBO_MAX_KEYS'] + 2)
+		flash = [('layer %d' % n, layer_size) for n in range(len(self.layer_rows))]
+		flash += [('macro %s' % m[0], s) for m, s in zip(self.macros, self.macro_sizes)]
+		flash += [('macro text dictionary', dict_size), ('combos', combo_size)]
+		ram = [('keymap_ram (%d layers)' % len(self.layer_rows), layer_size * len(self.layer_rows))]
+
+		header = '// Generated by tools/kmc.py from %s - do not edit.\n' % source
+		h = [header, '#ifndef _KEYMAP_GEN_H_', '#define _KEYMAP_GEN_H_', '', '#include <avr/pgmspace.h>', '']
+		h.append('#define KEYMAP_LAYERS\t%d' % len(self.layer_rows))
+		h.append('#define MACRO_COUNT\t%d' % len(self.macros))
+		h.append('#define MACROTEXT_COUNT\t%d' % len(self.zstrings))
+		h.append('')
+		h.append('// Macro numbers, for MACRO(n).')
+		for n, m in enumerate(self.macros): h.append('#define MACRO_ID_%s\t%d' % (m[0].upper(), n))
+		h.append('')
+		h.append('// Compressed text numbers, for M_ZSTRING actions.')
+		for n, (name, _, _) in enumerate(self.zstrings): h.append('#define TXT_%s_%d\t%d' % (name.upper(), n, n))
+		h += ['', 'extern const macro_t macro_data[] PROGMEM;', 'extern const uint16_t macro_offsets[] PROGMEM;',
+			'extern const uint8_t macrotext_dict[] PROGMEM;', 'extern const uint16_t macrotext_dict_offsets[] PROGMEM;',
+			'extern const uint8_t macrotext_data[] PROGMEM;', 'extern const uint16_t macrotext_offsets[] PROGMEM;', '', '#endif', '']
+
+		c = [header, '#include "keymap.h"', '']
+		c.append('// The key map array - one keymap per layer.')
+		c.append('const keycode_t KEYMAPS[][MATRIX_ROWS][MATRIX_COLS] PROGMEM =\n{')
+		for n, rows in enumerate(self.layer_rows):
+			c.append('\t{ // Layer %d' % n)
+			for r, row in enumerate(rows): c.append('\t\t{%s},\t// Row %d' % (', '.join(row), r))
+			c.append('\t},')
+		c.append('};')
+		c.append('const uint8_t keymap_num_layers = %d;' % len(self.layer_rows))
+		c.append('keycode_t keymap_ram[%d * MATRIX_KEYS];' % len(self.layer_rows))
+		c.append('')
+		c.append('// Packed macros, and the offset of each.')
+		c.append('const macro_t macro_data[] PROGMEM =\n{')
+		offsets, offset = [], 0
+		for (name, _, _), data in zip(self.macros, self.macro_bytes):
+			offsets.append(offset)
+			c.append('\t// MACRO(MACRO_ID_%s)' % name.upper())
+			for values, comment in data:
+				c.append('\t' + ', '.join(values) + ',' + (('\t// ' + comment) if comment else ''))
+				offset += len(values)
+		c.append('};')
+		c.append('const uint16_t macro_offsets[] PROGMEM = {%s};' % ', '.join(str(o) for o in offsets))
+		c.append('')
+		c.append('// The combo array - keys pressed together that send a different keycode.')
+		c.append('const combo_t COMBOS[] PROGMEM =\n{')
+		for positions, keycode, comment in self.combo_entries: c.append('\t{{%s}, %s},\t// %s' % (', '.join(positions), keycode, comment))
+		c.append('};')
+		c.append('const uint8_t num_combos = %d;' % len(self.combo_entries))
+		c.append('')
+		c.append('// Compressed macro text (see zstring.h): dictionary entries and the offset of each (plus the end of the last), then the')
+		c.append('// compressed text and the offset of each piece.')
+		dict_data, dict_offsets = [], [0]
+		for entry in self.dictionary:
+			dict_data += [ord(ch) for ch in entry]
+			dict_offsets.append(len(dict_data))
+		c.append('const uint8_t macrotext_dict[] PROGMEM =\n{\n%s\n};' % macrozip.c_bytes(dict_data))
+		c.append('const uint16_t macrotext_dict_offsets[] PROGMEM = {%s};' % ', '.join(str(o) for o in dict_offsets))
+		text_data, text_offsets = [], []
+		for _, _, codes in self.zstrings:
+			text_offsets.append(len(text_data))
+			text_data += codes + [0x00]
+		c.append('const uint8_t macrotext_data[] PROGMEM =\n{\n%s\n};' % macrozip.c_bytes(text_data))
+		c.append('const uint16_t macrotext_offsets[] PROGMEM = {%s};' % ', '.join(str(o) for o in text_offsets))
+		c.append('')
+
+		write_if_changed(os.path.join(gen_dir, 'keymap_gen.h'), '\n'.join(h))
+		write_if_changed(os.path.join(gen_dir, 'keymap_gen.c'), '\n'.join(c))
+
+		# Usage breakdown.
+		report = ['kmc: %s' % source]
+		for title, items, budget in (('flash', flash, self.budgets.get('flash')), ('ram', ram, self.budgets.get('ram'))):
+			total = sum(size for _, size in items)
+			report.append('  %s' % title)
+			for name, size in items: report.append('    %-32s %6d' % (name, size))
+			report.append('    %-32s %6d%s' % ('total', total, (' of %d' % budget) if budget is not None else ''))
+			if budget is not None and total > budget: fail(source, '%s budget exceeded (%d of %d bytes)' % (title, total, budget))
+		sys.stderr.write('\n'.join(report) + '\n')
+
+# Remove a # comment (not inside a string).
+def strip_comment(line):
+	quoted, escaped = False, False
+	for i, ch in enumerate(line):
+		if escaped: escaped = False
+		elif ch == '\\': escaped = True
+		elif ch == '"': quoted = not quoted
+		elif ch == '#' and not quoted: return line[:i]
+	return line
+
+def parse_string(where, text):
+	match = re.match(r'^"((?:[^"\\]|\\.)*)"$', text.strip())
+	if not match: fail(where, 'expected a "quoted string"')
+	escapes = {'n': '\n', 't': '\t', '\\': '\\', '"': '"'}
+	out, chars = '', iter(match.group(1))
+	for ch in chars:
+		if ch == '\\':
+			ch = next(chars)
+			if ch not in escapes: fail(where, 'unknown escape \\%s' % ch)
+			ch = escapes[ch]
+		out += ch
+	return out
+
+def c_char(ch):
+	return {'\n': "'\\n'", '\t': "'\\t'", '\\': "'\\\\'", "'": "'\\''"}.get(ch, "'%s'" % ch)
+
+def c_comment(text):
+	return macrozip.c_comment(text)
+
+def write_if_changed(path, text):
+	if os.path.exists(path):
+		with open(path) as f:
+			if f.read() == text: return
+	with open(path, 'w') as f: f.write(text)
+
+def main():
+	if len(sys.argv) != 4: sys.exit('usage: kmc.py keymap.km gen_dir include_dir')
+	source, gen_dir, include_dir = sys.argv[1:]
+	defines = {}
+	for header in ('keymap.h', 'keyscan.h'): defines.update(read_defines(os.path.join(include_dir, header)))
+	try:
+		compiler = Compiler(defines)
+		compiler.parse(source)
+		compiler.compile()
+		os.makedirs(gen_dir, exist_ok=True)
+		compiler.write(source, gen_dir)
+	except KeymapError as error:
+		sys.stderr.write('kmc: %s\n' % error)
+		sys.exit(1)
+
+if __name__ == '__main__':
+	main()
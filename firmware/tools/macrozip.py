@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Macro text compression for M_ZSTRING macro actions (see zstring.h).  Used by tools/kmc.py, which compresses all the text in the
+# keymap's macros together.
+#
+# The text is compressed against a static dictionary of up to 128 substrings that repeat across the whole corpus.  A compressed
+# string is a run of bytes ending with 0x00: bytes 0x01 to 0x7F are literal characters, bytes 0x80 to 0xFF are dictionary entry
+# (byte - 0x80).  Dictionary entries are plain text, so playback decodes one character at a time in constant RAM.
+#
+# Run on its own to see how well a file of text (one string per line, with the escapes \n, \t and \\) would compress.
+#
+# Usage: tools/macrozip.py text_file
+
+import sys
+
+DICT_MAX = 128		# Dictionary entries (one code byte each).
+ENTRY_MIN = 2		# Shortest entry worth a code.
+ENTRY_MAX = 24		# Longest entry considered.
+
+def parse(path):
+	strings = []
+	with open(path) as f:
+		for line in f:
+			line = line.rstrip('\n')
+			if not line: continue
+			text = line.replace('\\\\', '\0').replace('\\n', '\n').replace('\\t', '\t').replace('\0', '\\')
+			strings.append(''.join(c for c in text if 0x01 <= ord(c) <= 0x7F))
+	return strings
+
+# Cheapest encoding of text with the given dictionary (every byte costs one, literal or code).  Returns the list of codes.
+def encode(text, dictionary):
+	by_first = {}
+	for index, entry in enumerate(dictionary): by_first.setdefault(entry[0], []).append((entry, index))
+	cost = [0] * (len(text) + 1)
+	step = [None] * (len(text) + 1)
+	for i in range(len(text) - 1, -1, -1):
+		cost[i], step[i] = cost[i + 1] + 1, (1, ord(text[i]))
+		for entry, index in by_first.get(text[i], []):
+			if text.startswith(entry, i) and cost[i + len(entry)] + 1 < cost[i]:
+				cost[i], step[i] = cost[i + len(entry)] + 1, (len(entry), 0x80 | index)
+	codes, i = [], 0
+	while i < len(text):
+		codes.append(step[i][1])
+		i += step[i][0]
+	return codes
+
+# Greedily build the dictionary: repeatedly add the substring that saves the most bytes over the corpus as it is currently encoded,
+# counting the entry's own cost (its text plus a two byte offset).  Candidates are taken from the text still encoded as literals.
+def build_dictionary(texts):
+	dictionary = []
+	while len(dictionary) < DICT_MAX:
+		current = sum(len(encode(t, dictionary)) for t in texts)
+		counts = {}
+		for t in texts:
+			for run in literal_runs(t, dictionary):
+				for i in range(len(run)):
+					for n in range(ENTRY_MIN, min(ENTRY_MAX, len(run) - i) + 1):
+						counts[run[i:i + n]] = counts.get(run[i:i + n], 0) + 1
+		candidates = [c for c in counts if ((len(c) - 1) * counts[c]) > (len(c) + 2)]
+		candidates = sorted(candidates, key=lambda c: ((len(c) - 1) * counts[c]) - (len(c) + 2), reverse=True)[:32]
+		best, best_saving = None, 0
+		for c in candidates:
+			saving = current - sum(len(encode(t, dictionary + [c])) for t in texts) - (len(c) + 2)
+			if saving > best_saving: best, best_saving = c, saving
+		if not best: break
+		dictionary.append(best)
+	return dictionary
+
+# The parts of text that the dictionary leaves as literal characters.
+def literal_runs(text, dictionary):
+	runs, run, i = [], '', 0
+	for code in encode(text, dictionary):
+		if code & 0x80:
+			if run: runs.append(run)
+			run = ''
+			i += len(dictionary[code & 0x7F])
+		else:
+			run += text[i]
+			i += 1
+	if run: runs.append(run)
+	return runs
+
+def c_bytes(data):
+	lines = []
+	for i in range(0, len(data), 16): lines.append('\t' + ', '.join('0x%02X' % b for b in data[i:i + 16]) + ',')
+	return '\n'.join(lines)
+
+def c_comment(text):
+	return text.replace('\\', '\\\\').replace('\n', '\\n').replace('\t', '\\t').replace('*/', '*\\/')
+
+def main():
+	if len(sys.argv) != 2: sys.exit('usage: macrozip.py text_file')
+	strings = parse(sys.argv[1])
+	dictionary = build_dictionary(strings)
+	raw = sum(len(t) + 1 for t in strings)
+	packed = sum(len(encode(t, dictionary)) + 1 for t in strings) + sum(len(e) for e in dictionary) + 2 * (len(dictionary) + 1)
+	print('macrozip: %d strings, %d bytes of text -> %d bytes (%d dictionary entries)' % (len(strings), raw, packed, len(dictionary)))
+	for entry in dictionary: print('  "%s"' % c_comment(entry))
+
+if __name__ == '__main__':
+	main()